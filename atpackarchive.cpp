@@ -0,0 +1,213 @@
+#include "atpackarchive.h"
+#include "inflate.h"
+#include "crc32.h"
+
+#include <QDebug>
+#include <QtEndian>
+
+#include <limits>
+#include <cstring>
+
+static const quint32 k_localHeaderSignature = 0x04034b50;
+static const quint32 k_centralHeaderSignature = 0x02014b50;
+static const quint32 k_endOfDirectorySignature = 0x06054b50;
+
+static const int k_localHeaderSize = 30;
+static const int k_centralHeaderSize = 46;
+static const int k_endOfDirectorySize = 22;
+static const int k_maxCommentSize = 0xffff;
+
+static const quint16 k_methodStored = 0;
+static const quint16 k_methodDeflated = 8;
+static const quint16 k_flagEncrypted = 0x0001;
+
+static quint16 read16(const char *p)
+{
+    return qFromLittleEndian<quint16>(reinterpret_cast<const uchar *>(p));
+}
+
+static quint32 read32(const char *p)
+{
+    return qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(p));
+}
+
+AtpackArchive::AtpackArchive()
+{
+}
+
+bool AtpackArchive::isArchive(const QString &fileName)
+{
+    return fileName.endsWith(".atpack", Qt::CaseInsensitive);
+}
+
+bool AtpackArchive::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return fail(m_file.errorString());
+
+    if (!readDirectory())
+    {
+        m_file.close();
+        m_entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool AtpackArchive::readDirectory()
+{
+    // The end of central directory record sits at the very end, followed
+    // only by an optional comment of up to 64k
+    qint64 size = m_file.size();
+    qint64 tailSize = qMin<qint64>(size, k_endOfDirectorySize + k_maxCommentSize);
+    if (!m_file.seek(size - tailSize))
+        return fail(m_file.errorString());
+
+    QByteArray tail = m_file.read(tailSize);
+    int end = tail.size() - k_endOfDirectorySize;
+    while (end >= 0 && read32(tail.constData() + end) != k_endOfDirectorySignature)
+        --end;
+    if (end < 0)
+        return fail("Not a zip archive");
+
+    const char *record = tail.constData() + end;
+    quint16 entryCount = read16(record + 10);
+    quint32 directorySize = read32(record + 12);
+    quint32 directoryOffset = read32(record + 16);
+
+    // Packs are nowhere near the 4GB or 64k entry limits that need zip64
+    if (entryCount == 0xffff || directorySize == 0xffffffff || directoryOffset == 0xffffffff)
+        return fail("Zip64 archives are not supported");
+
+    if (static_cast<qint64>(directoryOffset) + directorySize > size || !m_file.seek(directoryOffset))
+        return fail("Corrupt central directory");
+
+    QByteArray directory = m_file.read(directorySize);
+    if (directory.size() != static_cast<int>(directorySize))
+        return fail("Corrupt central directory");
+
+    m_entries.reserve(entryCount);
+
+    int offset = 0;
+    for (quint16 i = 0; i < entryCount; ++i)
+    {
+        if (offset + k_centralHeaderSize > directory.size())
+            return fail("Corrupt central directory");
+
+        const char *header = directory.constData() + offset;
+        if (read32(header) != k_centralHeaderSignature)
+            return fail("Corrupt central directory");
+
+        quint16 flags = read16(header + 8);
+        quint16 nameSize = read16(header + 28);
+        quint16 extraSize = read16(header + 30);
+        quint16 commentSize = read16(header + 32);
+        if (offset + k_centralHeaderSize + nameSize > directory.size())
+            return fail("Corrupt central directory");
+
+        // Some Windows tools store backslashes
+        QString name = QString::fromUtf8(header + k_centralHeaderSize, nameSize);
+        name.replace('\\', '/');
+
+        Entry entry;
+        entry.method = read16(header + 10);
+        entry.crc = read32(header + 16);
+        entry.compressedSize = read32(header + 20);
+        entry.size = read32(header + 24);
+        entry.headerOffset = read32(header + 42);
+
+        // Directories and encrypted members are of no use
+        if (!name.endsWith('/') && !(flags & k_flagEncrypted))
+            m_entries.insert(name, entry);
+
+        offset += k_centralHeaderSize + nameSize + extraSize + commentSize;
+    }
+
+    return true;
+}
+
+void AtpackArchive::close()
+{
+    m_file.close();
+    m_entries.clear();
+    m_error.clear();
+}
+
+bool AtpackArchive::contains(const QString &name) const
+{
+    return m_entries.contains(name);
+}
+
+bool AtpackArchive::read(const QString &name, QByteArray *data)
+{
+    QHash<QString, Entry>::const_iterator it = m_entries.constFind(name);
+    if (it == m_entries.constEnd())
+        return fail(name + " not found in " + m_file.fileName());
+
+    const Entry &entry = it.value();
+    if (entry.method != k_methodStored && entry.method != k_methodDeflated)
+        return fail(name + " uses an unsupported compression method");
+
+    if (entry.size > static_cast<quint32>(std::numeric_limits<int>::max() - 1))
+        return fail(name + " is too large");
+
+    // The local header repeats the name and may have a different extra field,
+    // only its lengths are needed to find the data
+    if (!m_file.seek(entry.headerOffset))
+        return fail(m_file.errorString());
+
+    QByteArray header = m_file.read(k_localHeaderSize);
+    if (header.size() != k_localHeaderSize || read32(header.constData()) != k_localHeaderSignature)
+        return fail("Corrupt local header for " + name);
+
+    qint64 dataOffset = static_cast<qint64>(entry.headerOffset) + k_localHeaderSize
+            + read16(header.constData() + 26) + read16(header.constData() + 28);
+    if (dataOffset + entry.compressedSize > m_file.size())
+        return fail("Truncated archive member " + name);
+
+    // Map just this member so the rest of the archive is never touched
+    QByteArray buffer;
+    uchar *compressed = entry.compressedSize ? m_file.map(dataOffset, entry.compressedSize) : nullptr;
+    const uchar *in = compressed;
+    if (!in)
+    {
+        m_file.seek(dataOffset);
+        buffer = m_file.read(entry.compressedSize);
+        in = reinterpret_cast<const uchar *>(buffer.constData());
+    }
+
+    data->resize(static_cast<int>(entry.size));
+    bool ok;
+    if (entry.method == k_methodStored)
+    {
+        ok = entry.compressedSize == entry.size;
+        if (ok)
+            memcpy(data->data(), in, entry.size);
+    }
+    else
+    {
+        ok = inflateRaw(in, entry.compressedSize, reinterpret_cast<uchar *>(data->data()), entry.size);
+    }
+
+    if (compressed)
+        m_file.unmap(compressed);
+
+    if (!ok || calcCRC32(data->constData(), data->size()) != entry.crc)
+    {
+        data->clear();
+        return fail("Corrupt archive member " + name);
+    }
+
+    return true;
+}
+
+bool AtpackArchive::fail(const QString &error)
+{
+    m_error = error;
+    qDebug() << error;
+    return false;
+}
@@ -0,0 +1,47 @@
+#ifndef ATPACKARCHIVE_H
+#define ATPACKARCHIVE_H
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QByteArray>
+
+// Read access to the members of an .atpack, which is a plain zip archive.
+// Only the central directory is read on open, members are decompressed on
+// demand so a pack never has to be extracted to look at a few files in it.
+class AtpackArchive
+{
+public:
+    AtpackArchive();
+
+    static bool isArchive(const QString &fileName);
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const { return m_file.isOpen(); }
+
+    QString fileName() const { return m_file.fileName(); }
+    QString errorString() const { return m_error; }
+
+    bool contains(const QString &name) const;
+    bool read(const QString &name, QByteArray *data);
+
+private:
+    struct Entry
+    {
+        quint16 method;
+        quint32 crc;
+        quint32 compressedSize;
+        quint32 size;
+        quint32 headerOffset;
+    };
+
+    bool readDirectory();
+    bool fail(const QString &error);
+
+    QFile m_file;
+    QHash<QString, Entry> m_entries;
+    QString m_error;
+};
+
+#endif // ATPACKARCHIVE_H
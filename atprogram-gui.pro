@@ -6,7 +6,7 @@
 
 QT       += core gui
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 TARGET = atprogram-gui
 TEMPLATE = app
@@ -22,16 +22,40 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-CONFIG += c++11
+CONFIG += c++14
 
 SOURCES += \
         main.cpp \
+    atpackarchive.cpp \
+    crc32.cpp \
+    devicedescriptor.cpp \
+    deviceindex.cpp \
+    flashimage.cpp \
+    inflate.cpp \
         mainwindow.cpp \
+    packcatalog.cpp \
+    packmanifest.cpp \
+    packscanner.cpp \
+    startuptrace.cpp \
+    targetindex.cpp \
+    targetmodel.cpp \
     tinyxml2.cpp
 
 HEADERS += \
+    atpackarchive.h \
+    crc.h \
     crc32.h \
+    devicedescriptor.h \
+    deviceindex.h \
+    flashimage.h \
+    inflate.h \
         mainwindow.h \
+    packcatalog.h \
+    packmanifest.h \
+    packscanner.h \
+    startuptrace.h \
+    targetindex.h \
+    targetmodel.h \
     tinyxml2.h
 
 FORMS += \
@@ -0,0 +1,41 @@
+#-------------------------------------------------
+#
+# Parser benchmark, built separately from the GUI:
+#   qmake bench.pro && make && ./bench --help
+#
+#-------------------------------------------------
+
+QT       += core concurrent
+QT       -= gui
+
+TARGET = bench
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ../atpackarchive.cpp \
+    ../crc32.cpp \
+    ../devicedescriptor.cpp \
+    ../inflate.cpp \
+    ../packcatalog.cpp \
+    ../packmanifest.cpp \
+    ../startuptrace.cpp \
+    ../tinyxml2.cpp
+
+HEADERS += \
+    ../atpackarchive.h \
+    ../crc.h \
+    ../crc32.h \
+    ../devicedescriptor.h \
+    ../inflate.h \
+    ../packcatalog.h \
+    ../packmanifest.h \
+    ../startuptrace.h \
+    ../tinyxml2.h
@@ -0,0 +1,611 @@
+#include "devicedescriptor.h"
+#include "packcatalog.h"
+#include "tinyxml2.h"
+
+#include <QDir>
+#include <QFile>
+#include <QVector>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// Times the parsers over a generated corpus of growing size and over the
+// real packs, if any are installed. Numbers are the best of --repeat runs,
+// so the files are in the OS cache and only the parsing is measured.
+
+static const int k_corpusSizes[] = { 10, 100, 1000, 10000 };
+
+// Counts calls to C++ operator new only, the "new/file" column. That is all
+// tinyxml2 allocates with, but Qt allocates QString and container data with
+// malloc, so the manifest and descriptor numbers leave that out. Every form
+// of new is replaced, plain, nothrow and aligned, so none goes uncounted.
+static std::atomic<unsigned long long> s_allocations(0);
+
+static void *allocate(std::size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new(std::size_t size)
+{
+    if (void *p = allocate(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
+
+#if defined(__cpp_aligned_new)
+// Aligned allocations need their own free on Windows, so they never mix with the ones above
+static void *allocateAligned(std::size_t size, std::align_val_t alignment)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+#if defined(_WIN32)
+    return _aligned_malloc(size ? size : 1, static_cast<std::size_t>(alignment));
+#else
+    void *p = nullptr;
+    return posix_memalign(&p, static_cast<std::size_t>(alignment), size ? size : 1) == 0 ? p : nullptr;
+#endif
+}
+
+static void freeAligned(void *p)
+{
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void *p = allocateAligned(size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocateAligned(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    freeAligned(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+    freeAligned(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    freeAligned(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+    freeAligned(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+    freeAligned(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    freeAligned(p);
+}
+#endif
+
+// Deterministic, so every run parses exactly the same corpus
+class Random
+{
+public:
+    explicit Random(quint32 seed) : m_state(seed) {}
+
+    int below(int n)
+    {
+        m_state = m_state * 1664525u + 1013904223u;
+        return static_cast<int>((m_state >> 8) % static_cast<quint32>(n));
+    }
+
+private:
+    quint32 m_state;
+};
+
+static QString hex(quint32 value)
+{
+    return "0x" + QString::number(value, 16).toUpper();
+}
+
+static QByteArray manifest(int index, Random *random)
+{
+    QString xml;
+    QTextStream out(&xml);
+    out << "<?xml version=\"1.0\" encoding=\"ASCII\"?>\n"
+        << "<package xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" schema-version=\"1.0\">\n"
+        << "  <vendor>Atmel</vendor>\n"
+        << "  <name>BENCH" << index << "_DFP</name>\n"
+        << "  <version>1.0." << index << "</version>\n"
+        << "  <description>Generated pack " << index << "</description>\n"
+        << "  <content>\n";
+    const int targets = 1 + random->below(40);
+    for (int t = 0; t < targets; ++t)
+    {
+        const QString target = QString("ATbench%1x%2").arg(index).arg(t);
+        out << "    <resources target=\"" << target << "\">\n"
+            << "      <resource type=\"atdf\" subtype=\"\" path=\"atdf/" << target << ".atdf\"/>\n"
+            << "      <resource type=\"gcc\" subtype=\"header\" path=\"include/io" << target << ".h\"/>\n"
+            << "      <resource type=\"gcc\" subtype=\"specs\" path=\"gcc/dev/" << target << "/device-specs/specs-" << target << "\"/>\n"
+            << "    </resources>\n";
+    }
+    out << "  </content>\n"
+        << "</package>\n";
+    out.flush();
+    return xml.toUtf8();
+}
+
+static void registers(QTextStream &out, const QString &indent, int count, Random *random)
+{
+    for (int r = 0; r < count; ++r)
+    {
+        out << indent << "<register caption=\"Register " << r << "\" name=\"R" << r << "\" offset=\"" << hex(r)
+            << "\" size=\"1\" initval=\"" << hex(random->below(256)) << "\">\n";
+        const int bitfields = random->below(8);
+        for (int b = 0; b < bitfields; ++b)
+            out << indent << "  <bitfield caption=\"Bit " << b << "\" mask=\"" << hex(1u << b) << "\" name=\"B" << b << "\"/>\n";
+        out << indent << "</register>\n";
+    }
+}
+
+static QByteArray atdf(int index, Random *random)
+{
+    QString xml;
+    QTextStream out(&xml);
+    const QString name = QString("ATbench%1x0").arg(index);
+    const int modules = 5 + random->below(55);
+
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<avr-tools-device-file xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" schema-version=\"4.0\">\n"
+        << "  <variants>\n"
+        << "    <variant ordercode=\"" << name << "-AU\" package=\"TQFP32\" speedmax=\"20000000\" vccmin=\"1.8\" vccmax=\"5.5\"/>\n"
+        << "  </variants>\n"
+        << "  <devices>\n"
+        << "    <device name=\"" << name << "\" architecture=\"AVR8\" family=\"megaAVR\">\n"
+        << "      <address-spaces>\n"
+        << "        <address-space endianness=\"little\" name=\"prog\" id=\"prog\" start=\"0x0000\" size=\"0x8000\">\n"
+        << "          <memory-segment start=\"0x0000\" size=\"0x8000\" type=\"flash\" rw=\"RW\" exec=\"1\" name=\"FLASH\" pagesize=\"0x80\"/>\n"
+        << "        </address-space>\n"
+        << "        <address-space endianness=\"little\" name=\"eeprom\" id=\"eeprom\" start=\"0x0000\" size=\"0x0400\">\n"
+        << "          <memory-segment start=\"0x0000\" size=\"0x0400\" type=\"eeprom\" rw=\"RW\" exec=\"0\" name=\"EEPROM\" pagesize=\"0x04\"/>\n"
+        << "        </address-space>\n"
+        << "        <address-space endianness=\"little\" name=\"fuses\" id=\"fuses\" start=\"0\" size=\"3\">\n"
+        << "          <memory-segment start=\"0\" size=\"3\" type=\"fuses\" rw=\"RW\" exec=\"0\" name=\"FUSES\" pagesize=\"0x01\"/>\n"
+        << "        </address-space>\n"
+        << "      </address-spaces>\n"
+        << "      <peripherals>\n";
+    for (int m = 0; m < modules; ++m)
+        out << "        <module name=\"M" << m << "\">\n"
+            << "          <instance name=\"M" << m << "\" caption=\"Module " << m << "\">\n"
+            << "            <register-group name=\"M" << m << "\" name-in-module=\"M" << m << "\" offset=\"" << hex(m * 16) << "\" address-space=\"data\"/>\n"
+            << "          </instance>\n"
+            << "        </module>\n";
+    out << "      </peripherals>\n"
+        << "      <interrupts>\n";
+    for (int i = 0; i < modules / 2; ++i)
+        out << "        <interrupt index=\"" << i << "\" name=\"VECTOR" << i << "\" caption=\"Interrupt " << i << "\"/>\n";
+    out << "      </interrupts>\n"
+        << "      <interfaces>\n"
+        << "        <interface name=\"ISP\" type=\"isp\"/>\n"
+        << "        <interface name=\"debugWIRE\" type=\"dw\"/>\n"
+        << "      </interfaces>\n"
+        << "      <property-groups>\n"
+        << "        <property-group name=\"SIGNATURES\">\n"
+        << "          <property name=\"SIGNATURE0\" value=\"0x1E\"/>\n"
+        << "        </property-group>\n"
+        << "      </property-groups>\n"
+        << "    </device>\n"
+        << "  </devices>\n"
+        << "  <modules>\n";
+    for (int m = 0; m < modules; ++m)
+    {
+        out << "    <module caption=\"Module " << m << "\" name=\"" << (m == modules / 2 ? QString("FUSE") : QString("M%1").arg(m)) << "\">\n"
+            << "      <register-group caption=\"Module " << m << "\" name=\"M" << m << "\">\n";
+        registers(out, "        ", 1 + random->below(12), random);
+        out << "      </register-group>\n"
+            << "    </module>\n";
+    }
+    out << "  </modules>\n"
+        << "  <pinouts>\n"
+        << "    <pinout name=\"TQFP32\" caption=\"TQFP32\">\n";
+    for (int p = 1; p <= 32; ++p)
+        out << "      <pin position=\"" << p << "\" pad=\"P" << p << "\"/>\n";
+    out << "    </pinout>\n"
+        << "  </pinouts>\n"
+        << "</avr-tools-device-file>\n";
+    out.flush();
+    return xml.toUtf8();
+}
+
+static bool write(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+static bool generate(const QString &dir, int count, QStringList *manifests, QStringList *atdfs)
+{
+    Random random(1);
+    QDir().mkpath(dir);
+    for (int i = 0; i < count; ++i)
+    {
+        const QString manifestFile = QString("%1/m%2.content").arg(dir).arg(i, 5, 10, QChar('0'));
+        const QString atdfFile = QString("%1/d%2.atdf").arg(dir).arg(i, 5, 10, QChar('0'));
+        if (!write(manifestFile, manifest(i, &random)) || !write(atdfFile, atdf(i, &random)))
+            return false;
+        manifests->append(manifestFile);
+        atdfs->append(atdfFile);
+    }
+    return true;
+}
+
+// What one benchmark does to one file, returns false on failure
+typedef bool (*Parse)(const QString &fileName);
+
+static tinyxml2::XMLDocument *s_document = nullptr;
+
+static bool manifestTargets(const QString &fileName)
+{
+    // As the pack scanner does it: fast extractor, tinyxml2 when that gives up
+    return !PackCatalog::parseManifest(fileName, s_document).isEmpty();
+}
+
+static bool domLoad(const QString &fileName)
+{
+    tinyxml2::XMLDocument doc;
+    return doc.LoadFile(QFile::encodeName(fileName).constData()) == tinyxml2::XML_SUCCESS;
+}
+
+static bool descriptorLoad(const QString &fileName)
+{
+    DeviceDescriptor descriptor;
+    return descriptor.load(fileName);
+}
+
+// Everything a parse produced, line numbers included. Values are length
+// prefixed, so different results can't give the same dump.
+static void field(QByteArray *out, char kind, int line, const QByteArray &value)
+{
+    out->append(kind).append(QByteArray::number(line)).append(' ')
+        .append(QByteArray::number(value.size())).append(':').append(value);
+}
+
+static void dumpTree(const tinyxml2::XMLNode *node, QByteArray *out)
+{
+    for (const tinyxml2::XMLNode *child = node->FirstChild(); child; child = child->NextSibling())
+    {
+        const tinyxml2::XMLText *text = child->ToText();
+        const char kind = child->ToElement() ? 'E' : text ? (text->CData() ? 'C' : 'T')
+                        : child->ToComment() ? '!' : child->ToDeclaration() ? '?' : 'U';
+        field(out, kind, child->GetLineNum(), child->Value());
+        if (const tinyxml2::XMLElement *element = child->ToElement())
+        {
+            for (const tinyxml2::XMLAttribute *attribute = element->FirstAttribute(); attribute; attribute = attribute->Next())
+            {
+                field(out, '@', attribute->GetLineNum(), attribute->Name());
+                field(out, '=', attribute->GetLineNum(), attribute->Value());
+            }
+        }
+        dumpTree(child, out);
+        out->append('/');
+    }
+}
+
+static QByteArray domDump(const QByteArray &xml)
+{
+    tinyxml2::XMLDocument doc;
+    doc.Parse(xml.constData(), xml.size());
+    QByteArray out;
+    field(&out, 'X', doc.ErrorLineNum(), QByteArray::number(doc.ErrorID()));
+    dumpTree(&doc, &out);
+    return out;
+}
+
+static QByteArray readerDump(const QByteArray &xml)
+{
+    tinyxml2::XMLReader reader(xml.constData());
+    QByteArray out;
+    for (;;)
+    {
+        const tinyxml2::XMLReader::Event event = reader.Next();
+        if (event == tinyxml2::XMLReader::END_DOCUMENT || event == tinyxml2::XMLReader::PARSE_ERROR)
+            break;
+
+        const char kind = static_cast<char>('0' + event);
+        if (event == tinyxml2::XMLReader::TEXT)
+            field(&out, kind, reader.LineNum(), reader.Value());
+        else
+            field(&out, kind, reader.LineNum(), QByteArray(reader.Name(), static_cast<int>(reader.NameLength())));
+        if (event == tinyxml2::XMLReader::ATTRIBUTE)
+            field(&out, '=', reader.LineNum(), reader.Value());
+    }
+    field(&out, 'X', reader.LineNum(), QByteArray::number(reader.ErrorID()));
+    return out;
+}
+
+// Parses every file with the vector scanners and again with the scalar ones,
+// into a DOM and through XMLReader, and lists the files that come out different
+static bool compareScanners(QTextStream &out, const QStringList &files)
+{
+    if (!tinyxml2::XMLUtil::VectorScanning())
+    {
+        out << "This CPU or build has no vector scanners, nothing to compare\n";
+        return true;
+    }
+
+    int differences = 0;
+    foreach (const QString &fileName, files)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            out << "Can't read " << fileName << '\n';
+            differences++;
+            continue;
+        }
+        const QByteArray xml = file.readAll();
+
+        const QByteArray vectorDom = domDump(xml);
+        const QByteArray vectorReader = readerDump(xml);
+        tinyxml2::XMLUtil::SetVectorScanning(false);
+        const bool same = domDump(xml) == vectorDom && readerDump(xml) == vectorReader;
+        tinyxml2::XMLUtil::SetVectorScanning(true);
+        if (!same)
+        {
+            out << "Scanners differ on " << fileName << '\n';
+            differences++;
+        }
+    }
+
+    out << files.size() << " files compared, " << differences << " differ\n";
+    return differences == 0;
+}
+
+static qint64 totalSize(const QStringList &files)
+{
+    qint64 size = 0;
+    foreach (const QString &file, files)
+        size += QFileInfo(file).size();
+    return size;
+}
+
+static void run(QTextStream &out, const QString &corpus, const char *name, Parse parse, const QStringList &files, int repeat)
+{
+    if (files.isEmpty())
+        return;
+
+    qint64 best = -1;
+    unsigned long long allocations = 0;
+    int failures = 0;
+    for (int r = 0; r < repeat; ++r)
+    {
+        failures = 0;
+        const unsigned long long allocationsBefore = s_allocations.load();
+        QElapsedTimer timer;
+        timer.start();
+        foreach (const QString &file, files)
+        {
+            if (!parse(file))
+                failures++;
+        }
+        const qint64 nsecs = timer.nsecsElapsed();
+        allocations = s_allocations.load() - allocationsBefore;
+        if (best < 0 || nsecs < best)
+            best = nsecs;
+    }
+
+    const double seconds = qMax<qint64>(best, 1) / 1e9;
+    const double megabytes = totalSize(files) / (1024.0 * 1024.0);
+    out << corpus.leftJustified(10) << QString(name).leftJustified(18)
+        << QString::number(files.size()).rightJustified(7) << " files"
+        << QString::number(megabytes, 'f', 2).rightJustified(10) << " MB"
+        << QString::number(megabytes / seconds, 'f', 1).rightJustified(10) << " MB/s"
+        << QString::number(files.size() / seconds, 'f', 0).rightJustified(10) << " files/s"
+        << QString::number(static_cast<double>(allocations) / files.size(), 'f', 1).rightJustified(9) << " new/file";
+    if (failures)
+        out << "  (" << failures << " failed)";
+    out << '\n';
+    out.flush();
+}
+
+static void runAll(QTextStream &out, const QString &corpus, const QStringList &manifests, const QStringList &atdfs, int repeat)
+{
+    run(out, corpus, "manifest targets", manifestTargets, manifests, repeat);
+    run(out, corpus, "manifest DOM", domLoad, manifests, repeat);
+    run(out, corpus, "ATDF DOM", domLoad, atdfs, repeat);
+    run(out, corpus, "ATDF descriptor", descriptorLoad, atdfs, repeat);
+}
+
+// The places packs get installed to by Atmel/Microchip Studio and MPLAB X
+static QStringList defaultPacksDirs()
+{
+    QStringList dirs;
+    dirs << "C:/Program Files (x86)/Atmel/Studio/7.0/packs"
+         << "C:/Program Files (x86)/Microchip/Studio/7.0/packs"
+         << QDir::homePath() + "/.mchp_packs";
+    return dirs;
+}
+
+static void realPacks(const QString &packsDir, QStringList *manifests, QStringList *atdfs)
+{
+    foreach (const QFileInfo &manifest, PackCatalog::findManifests(packsDir))
+    {
+        // Device files inside .atpack archives are left out, that would time the inflater
+        if (manifest.suffix() != "content")
+            continue;
+
+        manifests->append(manifest.absoluteFilePath());
+        QDir atdfDir(manifest.absolutePath() + "/atdf");
+        foreach (const QFileInfo &atdf, atdfDir.entryInfoList(QStringList() << "*.atdf", QDir::Files))
+            atdfs->append(atdf.absoluteFilePath());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times tinyxml2, the manifest target extraction and the ATDF loader.");
+    parser.addHelpOption();
+    QCommandLineOption packsOption("packs", "Also time the packs installed in <dir>, instead of looking in the default places.", "dir");
+    QCommandLineOption maxOption("max", "Largest generated corpus, 10000 files by default. With --compare the generated files are only checked if this is given.", "files", "10000");
+    QCommandLineOption repeatOption("repeat", "Runs per benchmark, the best is reported. 3 by default.", "runs", "3");
+    QCommandLineOption compareOption("compare", "Instead of timing, check that the vector and the scalar scanners parse every file of the packs the same.");
+    parser.addOption(packsOption);
+    parser.addOption(maxOption);
+    parser.addOption(repeatOption);
+    parser.addOption(compareOption);
+    parser.process(a);
+
+    const int maxFiles = qMax(1, parser.value(maxOption).toInt());
+    const int repeat = qMax(1, parser.value(repeatOption).toInt());
+    const bool compare = parser.isSet(compareOption);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    tinyxml2::XMLDocument document;
+    document.SetArenaMode(true);
+    s_document = &document;
+
+    QTemporaryDir tempDir;
+    if (!tempDir.isValid())
+    {
+        err << "Can't create a directory for the corpus\n";
+        return 1;
+    }
+
+    // Each corpus is a prefix of the largest, so it's only written once
+    int largest = 0;
+    for (int size : k_corpusSizes)
+        largest = size <= maxFiles ? size : largest;
+
+    // A comparison is about the real packs, the generated files only when asked for
+    QStringList manifests, atdfs;
+    if (!compare || parser.isSet(maxOption))
+    {
+        err << "Generating " << largest << " manifests and device files in " << tempDir.path() << '\n';
+        err.flush();
+        if (!generate(tempDir.path(), largest, &manifests, &atdfs))
+        {
+            err << "Failed to write the corpus\n";
+            return 1;
+        }
+    }
+
+    QStringList packsDirs = parser.isSet(packsOption) ? QStringList(parser.value(packsOption)) : defaultPacksDirs();
+    if (compare)
+    {
+        foreach (const QString &packsDir, packsDirs)
+            realPacks(packsDir, &manifests, &atdfs);
+        if (manifests.isEmpty() && atdfs.isEmpty())
+        {
+            err << "No packs found, give --packs <dir> or --max <files> for a generated corpus\n";
+            return 1;
+        }
+        return compareScanners(out, manifests + atdfs) ? 0 : 1;
+    }
+
+    err << "new/file counts C++ operator new calls, not Qt's malloc allocations\n";
+    err.flush();
+
+    for (int size : k_corpusSizes)
+    {
+        if (size > largest)
+            break;
+        runAll(out, QString("gen %1").arg(size), manifests.mid(0, size), atdfs.mid(0, size), repeat);
+    }
+
+    foreach (const QString &packsDir, packsDirs)
+    {
+        QStringList realManifests, realAtdfs;
+        realPacks(packsDir, &realManifests, &realAtdfs);
+        if (realManifests.isEmpty())
+            continue;
+
+        err << "Real packs in " << packsDir << '\n';
+        err.flush();
+        runAll(out, "packs", realManifests, realAtdfs, repeat);
+    }
+
+    return 0;
+}
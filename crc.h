@@ -0,0 +1,119 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <QtGlobal>
+
+// Byte-wise table driven CRCs described by the usual Rocksoft parameters:
+// Width bits, Poly in normal (MSB first) form, Reflected for the LSB first
+// variants (input and output both reflected), then Init and XorOut. The table
+// is generated at compile time, so every variant is its own inlined kernel
+// with nothing to set up at runtime.
+//
+//   quint16 crc = CRC16CCITT::calc(data, size);
+//
+// For the zip CRC-32 of large buffers calcCRC32() in crc32.h is much faster.
+
+template <typename T>
+struct CRCTable
+{
+    T entries[256];
+};
+
+template <typename T>
+constexpr T reflectBits(T value, int bits)
+{
+    T result = 0;
+    for (int i = 0; i < bits; i++)
+    {
+        result = T((result << 1) | (value & 1));
+        value = T(value >> 1);
+    }
+    return result;
+}
+
+template <typename T, int Width>
+constexpr T crcMask()
+{
+    return T(T(~T(0)) >> (int(sizeof(T)) * 8 - Width));
+}
+
+template <typename T, int Width, T Poly, bool Reflected>
+constexpr CRCTable<T> makeCRCTable()
+{
+    CRCTable<T> table = {};
+    for (int i = 0; i < 256; i++)
+    {
+        T crc = 0;
+        if (Reflected)
+        {
+            const T poly = reflectBits<T>(Poly, Width);
+            crc = T(i);
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc & 1) ? T((crc >> 1) ^ poly) : T(crc >> 1);
+        }
+        else
+        {
+            const T top = T(T(1) << (Width - 1));
+            crc = T(T(i) << (Width - 8));
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc & top) ? T((crc << 1) ^ Poly) : T(crc << 1);
+        }
+        table.entries[i] = T(crc & crcMask<T, Width>());
+    }
+    return table;
+}
+
+template <typename T, int Width, T Poly, bool Reflected, T Init, T XorOut>
+class CRC
+{
+    static_assert(Width >= 8 && Width <= int(sizeof(T)) * 8, "CRC width must be at least 8 bits and fit in T");
+
+public:
+    typedef T Value;
+
+    static constexpr CRCTable<T> k_table = makeCRCTable<T, Width, Poly, Reflected>();
+
+    // Start with init(), update() any number of times, then finish()
+    static constexpr T init()
+    {
+        return Reflected ? reflectBits<T>(Init, Width) : Init;
+    }
+
+    static inline T update(T crc, const char *data, qint64 size)
+    {
+        const uchar *p = reinterpret_cast<const uchar *>(data);
+        if (Reflected)
+        {
+            while (size-- > 0)
+                crc = T((crc >> 8) ^ k_table.entries[(crc ^ *p++) & 0xff]);
+        }
+        else
+        {
+            while (size-- > 0)
+                crc = T(((crc << 8) ^ k_table.entries[((crc >> (Width - 8)) ^ *p++) & 0xff]) & crcMask<T, Width>());
+        }
+        return crc;
+    }
+
+    static constexpr T finish(T crc)
+    {
+        return T((crc ^ XorOut) & crcMask<T, Width>());
+    }
+
+    static inline T calc(const char *data, qint64 size)
+    {
+        return finish(update(init(), data, size));
+    }
+};
+
+template <typename T, int Width, T Poly, bool Reflected, T Init, T XorOut>
+constexpr CRCTable<T> CRC<T, Width, Poly, Reflected, Init, XorOut>::k_table;
+
+// AVR NVMCTRL CRCSCAN, the variant also known as CRC-16/CCITT-FALSE
+typedef CRC<quint16, 16, 0x1021, false, 0xffff, 0x0000> CRC16CCITT;
+// zip, ELF tools and getCRC32()
+typedef CRC<quint32, 32, 0x04c11db7, true, 0xffffffff, 0xffffffff> CRC32;
+// Castagnoli, used by our bootloader
+typedef CRC<quint32, 32, 0x1edc6f41, true, 0xffffffff, 0xffffffff> CRC32C;
+
+#endif // CRC_H
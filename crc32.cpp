@@ -0,0 +1,290 @@
+#include "crc32.h"
+#include "crc.h"
+
+#include <QFile>
+#include <QDebug>
+#include <QThread>
+#include <QtEndian>
+#include <QtConcurrent>
+
+// Carry-less multiply folding needs PCLMULQDQ, which is checked for at runtime
+// so the same binary still runs on CPUs without it
+#if defined(Q_PROCESSOR_X86) && (defined(Q_CC_GNU) || defined(Q_CC_MSVC))
+#define CRC32_CLMUL
+#include <immintrin.h>
+#ifdef Q_CC_MSVC
+#include <intrin.h>
+#define CRC32_CLMUL_TARGET
+#else
+#include <cpuid.h>
+#define CRC32_CLMUL_TARGET __attribute__((target("sse2,pclmul")))
+#endif
+#endif
+
+// Slicing-by-8: tables[k][i] is the CRC of byte i followed by k zero bytes,
+// so eight bytes are folded in with eight independent lookups per step.
+struct CRC32Tables
+{
+    quint32 t[8][256];
+};
+
+static constexpr CRC32Tables makeCRC32Tables()
+{
+    CRC32Tables tables = {};
+    for (int i = 0; i < 256; i++)
+    {
+        tables.t[0][i] = CRC32::k_table.entries[i];
+        for (int k = 1; k < 8; k++)
+            tables.t[k][i] = (tables.t[k - 1][i] >> 8) ^ CRC32::k_table.entries[tables.t[k - 1][i] & 0xff];
+    }
+    return tables;
+}
+
+static constexpr CRC32Tables k_crc32Tables = makeCRC32Tables();
+
+static quint32 updateCRC32Table(quint32 crc32, const uchar *p, qint64 size)
+{
+    const quint32 (*t)[256] = k_crc32Tables.t;
+
+    while (size >= 8)
+    {
+        quint32 one = qFromLittleEndian<quint32>(p) ^ crc32;
+        quint32 two = qFromLittleEndian<quint32>(p + 4);
+        crc32 = t[7][one & 0xff] ^ t[6][(one >> 8) & 0xff] ^ t[5][(one >> 16) & 0xff] ^ t[4][one >> 24] ^
+                t[3][two & 0xff] ^ t[2][(two >> 8) & 0xff] ^ t[1][(two >> 16) & 0xff] ^ t[0][two >> 24];
+        p += 8;
+        size -= 8;
+    }
+
+    while (size-- > 0)
+        crc32 = (crc32 >> 8) ^ t[0][(crc32 & 0xff) ^ *p++];
+
+    return crc32;
+}
+
+#ifdef CRC32_CLMUL
+static bool hasClmul()
+{
+    unsigned int regs[4] = {};
+#ifdef Q_CC_MSVC
+    __cpuid(reinterpret_cast<int *>(regs), 1);
+#else
+    __get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+    // ECX bit 1 is PCLMULQDQ, EDX bit 26 is SSE2
+    return (regs[2] & (1u << 1)) && (regs[3] & (1u << 26));
+}
+
+// Folds 64 bytes per step in four 128-bit lanes, then reduces to 32 bits
+// with a Barrett reduction. The constants are x^n mod P for the reflected
+// polynomial, from Intel's "Fast CRC Computation Using PCLMULQDQ" paper.
+// size must be a multiple of 16 and at least 64.
+CRC32_CLMUL_TARGET static quint32 updateCRC32Clmul(quint32 crc32, const uchar *p, qint64 size)
+{
+    const __m128i k1k2 = _mm_setr_epi32(0x54442bd4, 0x1, 0xc6e41596, 0x1);
+    const __m128i k3k4 = _mm_setr_epi32(0x751997d0, 0x1, 0xccaa009e, 0x0);
+    const __m128i k5 = _mm_setr_epi32(0x63cd6124, 0x1, 0x0, 0x0);
+    const __m128i poly = _mm_setr_epi32(0xdb710641, 0x1, 0xf7011641, 0x1);
+    const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+    __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32));
+    __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 48));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc32)));
+    p += 64;
+    size -= 64;
+
+    while (size >= 64)
+    {
+        __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 48)));
+        p += 64;
+        size -= 64;
+    }
+
+    // Four lanes into one
+    __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), x5);
+
+    while (size >= 16)
+    {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        p += 16;
+        size -= 16;
+    }
+
+    // 128 bits to 64
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, low32);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5, 0x00), x2);
+
+    // Barrett reduction to 32 bits
+    x2 = _mm_and_si128(x1, low32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, low32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<quint32>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+}
+#endif
+
+quint32 updateCRC32(quint32 crc32, const char *data, qint64 size)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+
+#ifdef CRC32_CLMUL
+    static const bool clmul = hasClmul();
+    if (clmul && size >= 64)
+    {
+        const qint64 folded = size & ~qint64(15);
+        crc32 = updateCRC32Clmul(crc32, p, folded);
+        p += folded;
+        size -= folded;
+    }
+#endif
+
+    return updateCRC32Table(crc32, p, size);
+}
+
+// Appending n zero bits to a CRC is linear over GF(2), so it is a 32x32 bit
+// matrix. Squaring it doubles n, which gets to any length in log2 steps.
+static quint32 gf2MatrixTimes(const quint32 *matrix, quint32 vector)
+{
+    quint32 sum = 0;
+    for (; vector; vector >>= 1, matrix++)
+    {
+        if (vector & 1)
+            sum ^= *matrix;
+    }
+    return sum;
+}
+
+static void gf2MatrixSquare(quint32 *square, const quint32 *matrix)
+{
+    for (int n = 0; n < 32; n++)
+        square[n] = gf2MatrixTimes(matrix, matrix[n]);
+}
+
+quint32 combineCRC32(quint32 crc1, quint32 crc2, qint64 size2)
+{
+    if (size2 <= 0)
+        return crc1;
+
+    // One zero bit, then two and four
+    quint32 even[32];
+    quint32 odd[32];
+    odd[0] = 0xedb88320;
+    for (int n = 1; n < 32; n++)
+        odd[n] = 1u << (n - 1);
+    gf2MatrixSquare(even, odd);
+    gf2MatrixSquare(odd, even);
+
+    // Shift crc1 past size2 zero bytes, a byte at a time from eight bits up
+    do
+    {
+        gf2MatrixSquare(even, odd);
+        if (size2 & 1)
+            crc1 = gf2MatrixTimes(even, crc1);
+        size2 >>= 1;
+        if (!size2)
+            break;
+
+        gf2MatrixSquare(odd, even);
+        if (size2 & 1)
+            crc1 = gf2MatrixTimes(odd, crc1);
+        size2 >>= 1;
+    } while (size2);
+
+    return crc1 ^ crc2;
+}
+
+struct CRC32Chunk
+{
+    const char *data;
+    qint64 size;
+};
+
+static quint32 calcChunkCRC32(const CRC32Chunk &chunk)
+{
+    return calcCRC32(chunk.data, chunk.size);
+}
+
+// Mapped files at least this big are hashed on the global thread pool
+static const qint64 k_parallelSize = 16 * 1024 * 1024;
+static const qint64 k_minimumChunkSize = 4 * 1024 * 1024;
+
+static quint32 calcMappedCRC32(const char *data, qint64 size)
+{
+    const int threads = QThread::idealThreadCount();
+    if (size < k_parallelSize || threads < 2)
+        return calcCRC32(data, size);
+
+    const qint64 chunkSize = qMax(k_minimumChunkSize, (size + threads - 1) / threads);
+    QVector<CRC32Chunk> chunks;
+    for (qint64 offset = 0; offset < size; offset += chunkSize)
+    {
+        CRC32Chunk chunk = { data + offset, qMin(chunkSize, size - offset) };
+        chunks.append(chunk);
+    }
+
+    QList<quint32> crcs = QtConcurrent::blockingMapped<QList<quint32> >(chunks, calcChunkCRC32);
+
+    quint32 crc32 = crcs.at(0);
+    for (int i = 1; i < chunks.size(); i++)
+        crc32 = combineCRC32(crc32, crcs.at(i), chunks.at(i).size);
+
+    return crc32;
+}
+
+QString getCRC32(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << file.errorString();
+        return QString();
+    }
+
+    quint32 crc32 = 0xffffffff;
+    const qint64 size = file.size();
+    const uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+
+    if (mapped)
+    {
+        crc32 = calcMappedCRC32(reinterpret_cast<const char *>(mapped), size);
+    }
+    else
+    {
+        // Large reads keep QFile out of the inner loop
+        static const qint64 k_blockSize = 256 * 1024;
+        QByteArray buffer(k_blockSize, Qt::Uninitialized);
+        qint64 n = 0;
+
+        while ((n = file.read(buffer.data(), k_blockSize)) > 0)
+            crc32 = updateCRC32(crc32, buffer.constData(), n);
+
+        crc32 ^= 0xffffffff;
+    }
+
+    return QString(QByteArray::number(crc32, 16).toUpper());
+}
@@ -0,0 +1,350 @@
+#include "devicedescriptor.h"
+#include "atpackarchive.h"
+#include "startuptrace.h"
+#include "tinyxml2.h"
+
+#include <QFile>
+#include <QHash>
+#include <QDebug>
+#include <QElapsedTimer>
+
+using namespace tinyxml2;
+
+// Reads the attributes of the element the reader has just started
+static QHash<QByteArray, QString> attributes(XMLReader *reader)
+{
+    QHash<QByteArray, QString> attributes;
+    while (reader->NextAttribute())
+        attributes.insert(QByteArray(reader->Name(), static_cast<int>(reader->NameLength())), QString::fromUtf8(reader->Value()));
+    return attributes;
+}
+
+static quint32 number(const QHash<QByteArray, QString> &attributes, const char *name)
+{
+    // ATDF numbers are mostly hex with a 0x prefix, base 0 handles both
+    return attributes.value(name).toUInt(nullptr, 0);
+}
+
+// Moves to the next child element of the current one. Returns false once the
+// reader is on the current element's end instead, or the document is over.
+static bool nextChild(XMLReader *reader)
+{
+    for (;;)
+    {
+        switch (reader->Next())
+        {
+        case XMLReader::START_ELEMENT:
+            return true;
+        case XMLReader::END_ELEMENT:
+        case XMLReader::END_DOCUMENT:
+        case XMLReader::PARSE_ERROR:
+            return false;
+        default:
+            break;
+        }
+    }
+}
+
+static int stringCost(const QString &s)
+{
+    return s.size() * static_cast<int>(sizeof(QChar));
+}
+
+QString DeviceDescriptor::atdfFile(const QString &packDir, const QString &target)
+{
+    return packDir + "/atdf/" + target + ".atdf";
+}
+
+bool DeviceDescriptor::load(const QString &packDir, const QString &target)
+{
+    if (!AtpackArchive::isArchive(packDir))
+        return load(atdfFile(packDir, target));
+
+    AtpackArchive archive;
+    return archive.open(packDir) && load(&archive, target);
+}
+
+bool DeviceDescriptor::load(AtpackArchive *archive, const QString &target)
+{
+    QByteArray data;
+    if (!archive->read("atdf/" + target + ".atdf", &data))
+        return false;
+
+    // QByteArray data is always null terminated
+    return read(data.constData(), archive->fileName() + ":" + target);
+}
+
+bool DeviceDescriptor::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "Failed to open" << fileName << file.errorString();
+        return false;
+    }
+
+    // Only the start of the file is usually read, so map it rather than read it all.
+    // The reader needs a null terminator, the zero filled end of the mapping's last
+    // page provides one unless the file fills that page.
+    const char *xml = nullptr;
+    const qint64 pageSize = static_cast<qint64>(XMLUtil::PageSize());
+    if (pageSize > 0 && file.size() % pageSize != 0)
+        xml = reinterpret_cast<const char *>(file.map(0, file.size()));
+
+    QByteArray data;
+    if (!xml)
+    {
+        data = file.readAll();
+        xml = data.constData();
+    }
+
+    return read(xml, fileName);
+}
+
+bool DeviceDescriptor::read(const char *xml, const QString &source)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    XMLReader reader(xml);
+    if (!nextChild(&reader) || !reader.NameIs("avr-tools-device-file"))
+    {
+        qDebug() << "Not an ATDF file" << source;
+        return false;
+    }
+
+    // Devices come before modules, everything after the fuse module is left unread
+    bool fusesRead = false;
+    while (!fusesRead && nextChild(&reader))
+    {
+        if (reader.NameIs("devices"))
+        {
+            while (nextChild(&reader))
+            {
+                if (reader.NameIs("device") && name.isEmpty())
+                    readDevice(&reader);
+                else
+                    reader.SkipElement();
+            }
+        }
+        else if (reader.NameIs("modules"))
+        {
+            while (!fusesRead && nextChild(&reader))
+            {
+                if (reader.NameIs("module") && attributes(&reader).value("name") == "FUSE")
+                {
+                    readFuses(&reader);
+                    fusesRead = true;
+                }
+                else
+                {
+                    reader.SkipElement();
+                }
+            }
+        }
+        else
+        {
+            reader.SkipElement();
+        }
+    }
+
+    // Reading stops after the fuses, the bytes show how much of the file that is
+    StartupTrace::count("atdf reads");
+    StartupTrace::count("atdf bytes read", static_cast<qint64>(reader.BytesRead()));
+    StartupTrace::count("atdf read ns", timer.nsecsElapsed());
+
+    if (reader.Current() == XMLReader::PARSE_ERROR)
+    {
+        qDebug() << "Failed to parse" << source << "line" << reader.LineNum() << XMLDocument::ErrorIDToName(reader.ErrorID());
+        // Nothing half read is kept, the device index stores whatever is left
+        *this = DeviceDescriptor();
+        return false;
+    }
+
+    return !name.isEmpty();
+}
+
+void DeviceDescriptor::readDevice(XMLReader *reader)
+{
+    const QHash<QByteArray, QString> device = attributes(reader);
+    name = device.value("name");
+    architecture = device.value("architecture");
+    family = device.value("family");
+
+    while (nextChild(reader))
+    {
+        if (reader->NameIs("address-spaces"))
+        {
+            while (nextChild(reader))
+            {
+                if (!reader->NameIs("address-space"))
+                {
+                    reader->SkipElement();
+                    continue;
+                }
+
+                const QString addressSpace = attributes(reader).value("id");
+                while (nextChild(reader))
+                {
+                    if (reader->NameIs("memory-segment"))
+                    {
+                        const QHash<QByteArray, QString> s = attributes(reader);
+                        MemorySegment segment;
+                        segment.name = s.value("name");
+                        segment.type = s.value("type");
+                        segment.addressSpace = addressSpace;
+                        segment.start = number(s, "start");
+                        segment.size = number(s, "size");
+                        segment.pageSize = number(s, "pagesize");
+                        segments.append(segment);
+                    }
+                    reader->SkipElement();
+                }
+            }
+        }
+        else if (reader->NameIs("interfaces"))
+        {
+            while (nextChild(reader))
+            {
+                if (reader->NameIs("interface"))
+                    interfaces.append(attributes(reader).value("name"));
+                reader->SkipElement();
+            }
+        }
+        else if (reader->NameIs("peripherals"))
+        {
+            // Only the names, the instances make up most of the device
+            while (nextChild(reader))
+            {
+                if (reader->NameIs("module"))
+                    peripherals.append(attributes(reader).value("name"));
+                reader->SkipElement();
+            }
+        }
+        else
+        {
+            // Interrupts and property groups
+            reader->SkipElement();
+        }
+    }
+}
+
+void DeviceDescriptor::readFuses(XMLReader *reader)
+{
+    while (nextChild(reader))
+    {
+        if (!reader->NameIs("register-group"))
+        {
+            reader->SkipElement();
+            continue;
+        }
+
+        while (nextChild(reader))
+        {
+            if (!reader->NameIs("register"))
+            {
+                reader->SkipElement();
+                continue;
+            }
+
+            const QHash<QByteArray, QString> r = attributes(reader);
+            FuseRegister fuse;
+            fuse.name = r.value("name");
+            fuse.offset = number(r, "offset");
+            fuse.size = number(r, "size");
+            fuse.initValue = number(r, "initval");
+            while (nextChild(reader))
+            {
+                if (reader->NameIs("bitfield"))
+                {
+                    const QHash<QByteArray, QString> b = attributes(reader);
+                    Bitfield bitfield = { b.value("name"), number(b, "mask") };
+                    fuse.bitfields.append(bitfield);
+                }
+                reader->SkipElement();
+            }
+            fuses.append(fuse);
+        }
+    }
+}
+
+const DeviceDescriptor::MemorySegment *DeviceDescriptor::segment(const QString &type) const
+{
+    foreach (const MemorySegment &segment, segments)
+    {
+        if (segment.type.compare(type, Qt::CaseInsensitive) == 0)
+            return &segment;
+    }
+    return nullptr;
+}
+
+bool DeviceDescriptor::supportsInterface(const QString &interface) const
+{
+    return interfaces.contains(interface, Qt::CaseInsensitive);
+}
+
+bool DeviceDescriptor::hasPeripheral(const QString &peripheral) const
+{
+    return peripherals.contains(peripheral, Qt::CaseInsensitive);
+}
+
+const DeviceDescriptor::FuseRegister *DeviceDescriptor::fuse(const QString &bitfield, quint32 *mask) const
+{
+    foreach (const FuseRegister &fuse, fuses)
+    {
+        foreach (const Bitfield &b, fuse.bitfields)
+        {
+            if (b.name.compare(bitfield, Qt::CaseInsensitive) == 0)
+            {
+                *mask = b.mask;
+                return &fuse;
+            }
+        }
+    }
+    return nullptr;
+}
+
+int DeviceDescriptor::cost() const
+{
+    int cost = static_cast<int>(sizeof(*this));
+    cost += stringCost(name) + stringCost(architecture) + stringCost(family);
+
+    foreach (const MemorySegment &segment, segments)
+        cost += static_cast<int>(sizeof(segment)) + stringCost(segment.name) + stringCost(segment.type) + stringCost(segment.addressSpace);
+
+    foreach (const FuseRegister &fuse, fuses)
+    {
+        cost += static_cast<int>(sizeof(fuse)) + stringCost(fuse.name);
+        foreach (const Bitfield &bitfield, fuse.bitfields)
+            cost += static_cast<int>(sizeof(bitfield)) + stringCost(bitfield.name);
+    }
+
+    foreach (const QString &interface, interfaces)
+        cost += static_cast<int>(sizeof(QString)) + stringCost(interface);
+
+    foreach (const QString &peripheral, peripherals)
+        cost += static_cast<int>(sizeof(QString)) + stringCost(peripheral);
+
+    return cost;
+}
+
+QString DeviceDescriptor::summary() const
+{
+    QStringList parts;
+
+    const MemorySegment *flash = segment("flash");
+    if (flash)
+        parts << QString("%1 KB flash in %2 byte pages").arg(flash->size / 1024).arg(flash->pageSize);
+
+    const MemorySegment *eeprom = segment("eeprom");
+    if (eeprom)
+        parts << QString("%1 bytes EEPROM").arg(eeprom->size);
+
+    if (!fuses.isEmpty())
+        parts << QString("%1 fuses").arg(fuses.size());
+
+    if (!interfaces.isEmpty())
+        parts << QString("interfaces %1").arg(interfaces.join(", "));
+
+    return QString("%1: %2").arg(name, parts.join(", "));
+}
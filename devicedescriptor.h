@@ -0,0 +1,78 @@
+#ifndef DEVICEDESCRIPTOR_H
+#define DEVICEDESCRIPTOR_H
+
+#include <QVector>
+#include <QString>
+#include <QStringList>
+
+namespace tinyxml2 {
+class XMLReader;
+}
+
+class AtpackArchive;
+
+// The parts of a device's ATDF file the GUI cares about
+class DeviceDescriptor
+{
+public:
+    struct MemorySegment
+    {
+        QString name;
+        QString type;
+        QString addressSpace;
+        quint32 start;
+        quint32 size;
+        quint32 pageSize;
+    };
+
+    struct Bitfield
+    {
+        QString name;
+        quint32 mask;
+    };
+
+    struct FuseRegister
+    {
+        QString name;
+        quint32 offset;
+        quint32 size;
+        quint32 initValue;
+        QVector<Bitfield> bitfields;
+    };
+
+    QString name;
+    QString architecture;
+    QString family;
+    QVector<MemorySegment> segments;
+    QVector<FuseRegister> fuses;
+    QStringList interfaces;
+    // Names of the peripheral modules: CRCSCAN, NVMCTRL, USART0, ...
+    QStringList peripherals;
+
+    static QString atdfFile(const QString &packDir, const QString &target);
+
+    // packDir may also be an .atpack, only the device's ATDF is unpacked
+    bool load(const QString &packDir, const QString &target);
+    bool load(AtpackArchive *archive, const QString &target);
+    bool load(const QString &fileName);
+
+    const MemorySegment *segment(const QString &type) const;
+    bool supportsInterface(const QString &interface) const;
+    bool hasPeripheral(const QString &peripheral) const;
+
+    // The fuse register with the named bitfield, and the bitfield's mask
+    const FuseRegister *fuse(const QString &bitfield, quint32 *mask) const;
+
+    // Rough heap footprint in bytes, used as the cost in the descriptor cache
+    int cost() const;
+
+    QString summary() const;
+
+private:
+    // xml has to be null terminated, source only names it in errors
+    bool read(const char *xml, const QString &source);
+    void readDevice(tinyxml2::XMLReader *reader);
+    void readFuses(tinyxml2::XMLReader *reader);
+};
+
+#endif // DEVICEDESCRIPTOR_H
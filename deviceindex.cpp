@@ -0,0 +1,471 @@
+#include "deviceindex.h"
+#include "packcatalog.h"
+#include "atpackarchive.h"
+#include "tinyxml2.h"
+
+#include <QDir>
+#include <QSet>
+#include <QHash>
+#include <QDebug>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+// File layout, every field is a little endian quint32:
+//
+//   header      magic, version, device count, segment count, interface count,
+//               peripheral count, fuse count, bitfield count, string table size,
+//               the file offsets of the seven tables, then the low and high
+//               word of the packs fingerprint
+//   devices     name, pack dir, architecture, family, first segment, segment
+//               count, first interface, interface count, first peripheral,
+//               peripheral count, first fuse, fuse count; sorted by name so
+//               lookups can binary search
+//   segments    name, type, address space, start, size, page size
+//   interfaces  one string offset each
+//   peripherals one string offset each
+//   fuses       name, offset, size, initial value, first bitfield, bitfield count
+//   bitfields   name, mask
+//   strings     NUL terminated UTF-8, each distinct string stored once
+//
+// Pack dirs are relative to the packs directory the index sits in and
+// may name an .atpack archive instead of a directory.
+static const quint32 k_indexMagic   = 0x58445441; // "ATDX"
+static const quint32 k_indexVersion = 4;
+
+enum { HeaderFields = 18, DeviceFields = 12, SegmentFields = 6, FuseFields = 6, BitfieldFields = 2 };
+
+static quint32 field(const uchar *record, int index)
+{
+    return qFromLittleEndian<quint32>(record + index * sizeof(quint32));
+}
+
+class StringTable
+{
+public:
+    quint32 add(const QString &s)
+    {
+        QByteArray utf8 = s.toUtf8();
+        QHash<QByteArray, quint32>::const_iterator it = m_offsets.constFind(utf8);
+        if (it != m_offsets.constEnd())
+            return it.value();
+
+        quint32 offset = static_cast<quint32>(m_data.size());
+        m_data.append(utf8).append('\0');
+        m_offsets.insert(utf8, offset);
+        return offset;
+    }
+
+    const QByteArray &data() const { return m_data; }
+
+private:
+    QByteArray m_data;
+    QHash<QByteArray, quint32> m_offsets;
+};
+
+static void append(QByteArray *out, quint32 value)
+{
+    uchar bytes[sizeof(quint32)];
+    qToLittleEndian(value, bytes);
+    out->append(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+}
+
+DeviceIndex::DeviceIndex() :
+    m_data(nullptr),
+    m_fingerprint(0),
+    m_deviceCount(0),
+    m_segmentCount(0),
+    m_interfaceCount(0),
+    m_peripheralCount(0),
+    m_fuseCount(0),
+    m_bitfieldCount(0),
+    m_stringSize(0),
+    m_devices(nullptr),
+    m_segments(nullptr),
+    m_interfaces(nullptr),
+    m_peripherals(nullptr),
+    m_fuses(nullptr),
+    m_bitfields(nullptr),
+    m_strings(nullptr)
+{
+}
+
+DeviceIndex::~DeviceIndex()
+{
+    close();
+}
+
+QString DeviceIndex::defaultFile(const QString &packsDir)
+{
+    return QDir(packsDir).filePath("devices.idx");
+}
+
+bool DeviceIndex::build(const QString &packsDir, const QString &fileName, QString *error)
+{
+    QDir root(packsDir);
+
+    QFileInfoList manifests = PackCatalog::findManifests(packsDir);
+
+    struct Device
+    {
+        QString name;
+        QString packDir;
+    };
+
+    QVector<Device> devices;
+    QSet<QString> seen;
+    tinyxml2::XMLDocument doc;
+    doc.SetArenaMode(true);
+    foreach (const QFileInfo &manifest, manifests)
+    {
+        QString packDir = PackCatalog::packLocation(manifest);
+        foreach (const QString &target, PackCatalog::parseManifest(manifest.absoluteFilePath(), &doc))
+        {
+            if (seen.contains(target))
+                continue;
+            seen.insert(target);
+
+            Device device = { target, packDir };
+            devices.append(device);
+        }
+    }
+
+    std::sort(devices.begin(), devices.end(), [](const Device &a, const Device &b) {
+        return a.name.toUtf8() < b.name.toUtf8();
+    });
+
+    StringTable strings;
+    QByteArray deviceTable, segmentTable, interfaceTable, peripheralTable, fuseTable, bitfieldTable;
+    quint32 segmentCount = 0, interfaceCount = 0, peripheralCount = 0, fuseCount = 0, bitfieldCount = 0;
+
+    // Archives stay open for the whole build, rereading the central
+    // directory for every device would dominate the time spent
+    QHash<QString, AtpackArchive *> archives;
+
+    foreach (const Device &device, devices)
+    {
+        bool loaded;
+        DeviceDescriptor descriptor;
+        if (AtpackArchive::isArchive(device.packDir))
+        {
+            AtpackArchive *archive = archives.value(device.packDir);
+            if (!archive)
+            {
+                archive = new AtpackArchive;
+                archive->open(device.packDir);
+                archives.insert(device.packDir, archive);
+            }
+            loaded = archive->isOpen() && descriptor.load(archive, device.name);
+        }
+        else
+        {
+            loaded = descriptor.load(device.packDir, device.name);
+        }
+
+        if (!loaded)
+            qDebug() << "No device file for" << device.name;
+
+        append(&deviceTable, strings.add(device.name));
+        append(&deviceTable, strings.add(root.relativeFilePath(device.packDir)));
+        append(&deviceTable, strings.add(descriptor.architecture));
+        append(&deviceTable, strings.add(descriptor.family));
+        append(&deviceTable, segmentCount);
+        append(&deviceTable, static_cast<quint32>(descriptor.segments.size()));
+        append(&deviceTable, interfaceCount);
+        append(&deviceTable, static_cast<quint32>(descriptor.interfaces.size()));
+        append(&deviceTable, peripheralCount);
+        append(&deviceTable, static_cast<quint32>(descriptor.peripherals.size()));
+        append(&deviceTable, fuseCount);
+        append(&deviceTable, static_cast<quint32>(descriptor.fuses.size()));
+
+        foreach (const DeviceDescriptor::MemorySegment &segment, descriptor.segments)
+        {
+            append(&segmentTable, strings.add(segment.name));
+            append(&segmentTable, strings.add(segment.type));
+            append(&segmentTable, strings.add(segment.addressSpace));
+            append(&segmentTable, segment.start);
+            append(&segmentTable, segment.size);
+            append(&segmentTable, segment.pageSize);
+            ++segmentCount;
+        }
+
+        foreach (const QString &interface, descriptor.interfaces)
+        {
+            append(&interfaceTable, strings.add(interface));
+            ++interfaceCount;
+        }
+
+        foreach (const QString &peripheral, descriptor.peripherals)
+        {
+            append(&peripheralTable, strings.add(peripheral));
+            ++peripheralCount;
+        }
+
+        foreach (const DeviceDescriptor::FuseRegister &fuse, descriptor.fuses)
+        {
+            append(&fuseTable, strings.add(fuse.name));
+            append(&fuseTable, fuse.offset);
+            append(&fuseTable, fuse.size);
+            append(&fuseTable, fuse.initValue);
+            append(&fuseTable, bitfieldCount);
+            append(&fuseTable, static_cast<quint32>(fuse.bitfields.size()));
+            ++fuseCount;
+
+            foreach (const DeviceDescriptor::Bitfield &bitfield, fuse.bitfields)
+            {
+                append(&bitfieldTable, strings.add(bitfield.name));
+                append(&bitfieldTable, bitfield.mask);
+                ++bitfieldCount;
+            }
+        }
+    }
+
+    qDeleteAll(archives);
+
+    quint32 deviceOffset = HeaderFields * sizeof(quint32);
+    quint32 segmentOffset = deviceOffset + static_cast<quint32>(deviceTable.size());
+    quint32 interfaceOffset = segmentOffset + static_cast<quint32>(segmentTable.size());
+    quint32 peripheralOffset = interfaceOffset + static_cast<quint32>(interfaceTable.size());
+    quint32 fuseOffset = peripheralOffset + static_cast<quint32>(peripheralTable.size());
+    quint32 bitfieldOffset = fuseOffset + static_cast<quint32>(fuseTable.size());
+    quint32 stringOffset = bitfieldOffset + static_cast<quint32>(bitfieldTable.size());
+
+    QByteArray header;
+    append(&header, k_indexMagic);
+    append(&header, k_indexVersion);
+    append(&header, static_cast<quint32>(devices.size()));
+    append(&header, segmentCount);
+    append(&header, interfaceCount);
+    append(&header, peripheralCount);
+    append(&header, fuseCount);
+    append(&header, bitfieldCount);
+    append(&header, static_cast<quint32>(strings.data().size()));
+    append(&header, deviceOffset);
+    append(&header, segmentOffset);
+    append(&header, interfaceOffset);
+    append(&header, peripheralOffset);
+    append(&header, fuseOffset);
+    append(&header, bitfieldOffset);
+    append(&header, stringOffset);
+
+    // Lets the GUI notice packs installed or updated after the index was built
+    quint64 packsFingerprint = PackCatalog::fingerprint(packsDir, manifests);
+    append(&header, static_cast<quint32>(packsFingerprint));
+    append(&header, static_cast<quint32>(packsFingerprint >> 32));
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        *error = file.errorString();
+        return false;
+    }
+
+    file.write(header);
+    file.write(deviceTable);
+    file.write(segmentTable);
+    file.write(interfaceTable);
+    file.write(peripheralTable);
+    file.write(fuseTable);
+    file.write(bitfieldTable);
+    file.write(strings.data());
+
+    if (!file.commit())
+    {
+        *error = file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool DeviceIndex::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 size = m_file.size();
+    const uchar *data = size >= HeaderFields * static_cast<qint64>(sizeof(quint32)) ? m_file.map(0, size) : nullptr;
+    if (!data || field(data, 0) != k_indexMagic || field(data, 1) != k_indexVersion)
+    {
+        qDebug() << "Ignoring invalid device index" << fileName;
+        m_file.close();
+        return false;
+    }
+
+    quint32 devices = field(data, 2);
+    quint32 segments = field(data, 3);
+    quint32 interfaces = field(data, 4);
+    quint32 peripherals = field(data, 5);
+    quint32 fuses = field(data, 6);
+    quint32 bitfields = field(data, 7);
+    quint32 strings = field(data, 8);
+    quint64 deviceOffset = field(data, 9);
+    quint64 segmentOffset = field(data, 10);
+    quint64 interfaceOffset = field(data, 11);
+    quint64 peripheralOffset = field(data, 12);
+    quint64 fuseOffset = field(data, 13);
+    quint64 bitfieldOffset = field(data, 14);
+    quint64 stringOffset = field(data, 15);
+
+    // Every table has to fit, and the string table has to be terminated
+    const quint64 word = sizeof(quint32);
+    if (deviceOffset + quint64(devices) * DeviceFields * word > quint64(size) ||
+        segmentOffset + quint64(segments) * SegmentFields * word > quint64(size) ||
+        interfaceOffset + quint64(interfaces) * word > quint64(size) ||
+        peripheralOffset + quint64(peripherals) * word > quint64(size) ||
+        fuseOffset + quint64(fuses) * FuseFields * word > quint64(size) ||
+        bitfieldOffset + quint64(bitfields) * BitfieldFields * word > quint64(size) ||
+        stringOffset + strings > quint64(size) ||
+        (strings > 0 && data[stringOffset + strings - 1] != '\0'))
+    {
+        qDebug() << "Ignoring truncated device index" << fileName;
+        m_file.close();
+        return false;
+    }
+
+    m_data = data;
+    m_fingerprint = field(data, 16) | quint64(field(data, 17)) << 32;
+    m_packsDir = QFileInfo(fileName).absolutePath();
+    m_deviceCount = devices;
+    m_segmentCount = segments;
+    m_interfaceCount = interfaces;
+    m_peripheralCount = peripherals;
+    m_fuseCount = fuses;
+    m_bitfieldCount = bitfields;
+    m_stringSize = strings;
+    m_devices = data + deviceOffset;
+    m_segments = data + segmentOffset;
+    m_interfaces = data + interfaceOffset;
+    m_peripherals = data + peripheralOffset;
+    m_fuses = data + fuseOffset;
+    m_bitfields = data + bitfieldOffset;
+    m_strings = reinterpret_cast<const char *>(data + stringOffset);
+    return true;
+}
+
+void DeviceIndex::close()
+{
+    // Closing the file unmaps it
+    m_file.close();
+    m_data = nullptr;
+    m_fingerprint = 0;
+    m_deviceCount = m_segmentCount = m_interfaceCount = m_peripheralCount = m_fuseCount = m_bitfieldCount = m_stringSize = 0;
+}
+
+QStringList DeviceIndex::targets() const
+{
+    QStringList result;
+    result.reserve(count());
+    for (quint32 i = 0; i < m_deviceCount; ++i)
+        result.append(string(field(m_devices + i * DeviceFields * sizeof(quint32), 0)));
+    return result;
+}
+
+QString DeviceIndex::packDir(const QString &target) const
+{
+    const uchar *device = find(target);
+    if (!device)
+        return QString();
+
+    return QDir::cleanPath(m_packsDir + '/' + string(field(device, 1)));
+}
+
+bool DeviceIndex::descriptor(const QString &target, DeviceDescriptor *descriptor) const
+{
+    const uchar *device = find(target);
+    if (!device)
+        return false;
+
+    descriptor->name = target;
+    descriptor->architecture = string(field(device, 2));
+    descriptor->family = string(field(device, 3));
+
+    quint32 first = field(device, 4), count = field(device, 5);
+    for (quint32 i = first; i < first + count && i < m_segmentCount; ++i)
+    {
+        const uchar *record = m_segments + i * SegmentFields * sizeof(quint32);
+
+        DeviceDescriptor::MemorySegment segment;
+        segment.name = string(field(record, 0));
+        segment.type = string(field(record, 1));
+        segment.addressSpace = string(field(record, 2));
+        segment.start = field(record, 3);
+        segment.size = field(record, 4);
+        segment.pageSize = field(record, 5);
+        descriptor->segments.append(segment);
+    }
+
+    first = field(device, 6);
+    count = field(device, 7);
+    for (quint32 i = first; i < first + count && i < m_interfaceCount; ++i)
+        descriptor->interfaces.append(string(field(m_interfaces, static_cast<int>(i))));
+
+    first = field(device, 8);
+    count = field(device, 9);
+    for (quint32 i = first; i < first + count && i < m_peripheralCount; ++i)
+        descriptor->peripherals.append(string(field(m_peripherals, static_cast<int>(i))));
+
+    first = field(device, 10);
+    count = field(device, 11);
+    for (quint32 i = first; i < first + count && i < m_fuseCount; ++i)
+    {
+        const uchar *record = m_fuses + i * FuseFields * sizeof(quint32);
+
+        DeviceDescriptor::FuseRegister fuse;
+        fuse.name = string(field(record, 0));
+        fuse.offset = field(record, 1);
+        fuse.size = field(record, 2);
+        fuse.initValue = field(record, 3);
+        quint32 firstBitfield = field(record, 4), bitfieldCount = field(record, 5);
+        for (quint32 b = firstBitfield; b < firstBitfield + bitfieldCount && b < m_bitfieldCount; ++b)
+        {
+            const uchar *bitfieldRecord = m_bitfields + b * BitfieldFields * sizeof(quint32);
+            DeviceDescriptor::Bitfield bitfield = { string(field(bitfieldRecord, 0)), field(bitfieldRecord, 1) };
+            fuse.bitfields.append(bitfield);
+        }
+        descriptor->fuses.append(fuse);
+    }
+
+    return true;
+}
+
+const uchar *DeviceIndex::find(const QString &target) const
+{
+    if (!m_data)
+        return nullptr;
+
+    QByteArray key = target.toUtf8();
+
+    // Devices are sorted by the bytes of their names
+    quint32 low = 0, high = m_deviceCount;
+    while (low < high)
+    {
+        quint32 mid = low + (high - low) / 2;
+        const uchar *device = m_devices + mid * DeviceFields * sizeof(quint32);
+        quint32 offset = field(device, 0);
+        if (offset >= m_stringSize)
+            return nullptr;
+
+        int result = strcmp(m_strings + offset, key.constData());
+        if (result == 0)
+            return device;
+        if (result < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return nullptr;
+}
+
+QString DeviceIndex::string(quint32 offset) const
+{
+    if (offset >= m_stringSize)
+        return QString();
+    return QString::fromUtf8(m_strings + offset);
+}
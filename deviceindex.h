@@ -0,0 +1,62 @@
+#ifndef DEVICEINDEX_H
+#define DEVICEINDEX_H
+
+#include "devicedescriptor.h"
+
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+// Read-only view of the binary device index the installer generates from
+// the packs (see build()). Mapping it replaces the startup pack scan: device
+// names, memory segments, page sizes, interfaces, peripherals and fuses are
+// all in one file, with every string stored once as an offset into a string
+// table.
+// descriptor() gives exactly what DeviceDescriptor::load() reads from the ATDF.
+class DeviceIndex
+{
+public:
+    DeviceIndex();
+    ~DeviceIndex();
+
+    static QString defaultFile(const QString &packsDir);
+    static bool build(const QString &packsDir, const QString &fileName, QString *error);
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    // PackCatalog::fingerprint() of the packs the index was built from
+    quint64 fingerprint() const { return m_fingerprint; }
+
+    int count() const { return static_cast<int>(m_deviceCount); }
+    QStringList targets() const;
+
+    QString packDir(const QString &target) const;
+    bool descriptor(const QString &target, DeviceDescriptor *descriptor) const;
+
+private:
+    QFile m_file;
+    const uchar *m_data;
+    quint64 m_fingerprint;
+    QString m_packsDir;
+    quint32 m_deviceCount;
+    quint32 m_segmentCount;
+    quint32 m_interfaceCount;
+    quint32 m_peripheralCount;
+    quint32 m_fuseCount;
+    quint32 m_bitfieldCount;
+    quint32 m_stringSize;
+    const uchar *m_devices;
+    const uchar *m_segments;
+    const uchar *m_interfaces;
+    const uchar *m_peripherals;
+    const uchar *m_fuses;
+    const uchar *m_bitfields;
+    const char *m_strings;
+
+    const uchar *find(const QString &target) const;
+    QString string(quint32 offset) const;
+};
+
+#endif // DEVICEINDEX_H
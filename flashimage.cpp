@@ -0,0 +1,192 @@
+#include "flashimage.h"
+#include "crc.h"
+#include "crc32.h"
+
+#include <QFile>
+#include <QDebug>
+#include <QtEndian>
+
+#include <cstring>
+
+static const quint32 k_elfProgramHeaderSize = 32;
+static const quint32 k_elfLoad = 1;
+
+static quint16 read16(const char *p)
+{
+    return qFromLittleEndian<quint16>(reinterpret_cast<const uchar *>(p));
+}
+
+static quint32 read32(const char *p)
+{
+    return qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(p));
+}
+
+FlashImage::FlashImage(quint32 start, quint32 size) :
+    m_start(start),
+    m_data(static_cast<int>(size), '\xff'),
+    m_fuseAddress(0)
+{
+}
+
+bool FlashImage::add(const QString &fileName)
+{
+    m_fileName = fileName;
+    m_error.clear();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+
+    QByteArray contents = file.readAll();
+    if (contents.startsWith("\x7f" "ELF"))
+        return addElf(contents);
+    if (contents.startsWith(':'))
+        return addHex(contents);
+
+    return fail("Not an Intel HEX or ELF file");
+}
+
+void FlashImage::setFuses(quint32 address, quint32 size)
+{
+    m_fuseAddress = address;
+    m_fuses = QByteArray(static_cast<int>(size), '\xff');
+    m_fusesSet = QByteArray(static_cast<int>(size), '\0');
+}
+
+bool FlashImage::fuse(quint32 offset, quint8 *value) const
+{
+    if (offset >= static_cast<quint32>(m_fuses.size()) || !m_fusesSet.at(offset))
+        return false;
+
+    *value = static_cast<quint8>(m_fuses.at(offset));
+    return true;
+}
+
+quint16 FlashImage::crc16() const
+{
+    return CRC16CCITT::calc(m_data.constData(), m_data.size());
+}
+
+quint32 FlashImage::crc32() const
+{
+    return calcCRC32(m_data.constData(), m_data.size());
+}
+
+QString FlashImage::crcScanFile(const QString &fileName)
+{
+    return fileName + ".crcscan";
+}
+
+bool FlashImage::addHex(const QByteArray &contents)
+{
+    quint32 base = 0;
+    int lineNumber = 0;
+
+    foreach (QByteArray line, contents.split('\n'))
+    {
+        lineNumber++;
+        line = line.trimmed();
+        if (line.isEmpty())
+            continue;
+
+        // :LLAAAATT<data>CC, the checksum makes all bytes add up to 0
+        QByteArray record = QByteArray::fromHex(line.mid(1));
+        if (line.at(0) != ':' || line.size() % 2 == 0 || record.size() < 5 ||
+            record.size() != 5 + static_cast<uchar>(record.at(0)))
+        {
+            return fail(QString("Malformed record on line %1").arg(lineNumber));
+        }
+
+        quint8 sum = 0;
+        for (int i = 0; i < record.size(); i++)
+            sum += static_cast<quint8>(record.at(i));
+        if (sum != 0)
+            return fail(QString("Bad checksum on line %1").arg(lineNumber));
+
+        const quint32 size = static_cast<uchar>(record.at(0));
+        const quint32 offset = qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(record.constData() + 1));
+        const char *data = record.constData() + 4;
+        switch (record.at(3))
+        {
+        case 0x00:
+            if (!place(quint64(base) + offset, data, size))
+                return false;
+            break;
+        case 0x01:
+            return true;
+        case 0x02:
+            base = quint32(qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(data))) << 4;
+            break;
+        case 0x04:
+            base = quint32(qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(data))) << 16;
+            break;
+        default:
+            // Start addresses don't end up in the flash
+            break;
+        }
+    }
+
+    return fail("No end of file record");
+}
+
+bool FlashImage::addElf(const QByteArray &contents)
+{
+    // AVR and ARM images are both 32-bit little endian
+    const char *elf = contents.constData();
+    const quint32 size = static_cast<quint32>(contents.size());
+    if (size < 0x34 || elf[4] != 1 || elf[5] != 1)
+        return fail("Only 32-bit little endian ELF files are supported");
+
+    const quint32 phoff = read32(elf + 0x1c);
+    const quint32 phentsize = read16(elf + 0x2a);
+    const quint32 phnum = read16(elf + 0x2c);
+    if (phentsize < k_elfProgramHeaderSize || quint64(phoff) + quint64(phnum) * phentsize > size)
+        return fail("Truncated program header table");
+
+    for (quint32 i = 0; i < phnum; i++)
+    {
+        const char *header = elf + phoff + i * phentsize;
+        const quint32 offset = read32(header + 4);
+        const quint32 paddr = read32(header + 12);
+        const quint32 filesz = read32(header + 16);
+        if (read32(header) != k_elfLoad || filesz == 0)
+            continue;
+
+        if (quint64(offset) + filesz > size)
+            return fail(QString("Program header %1 points past the end of the file").arg(i));
+
+        // The physical address is where the loader puts it, .data's initial
+        // values live in flash even though the code sees them in RAM
+        if (!place(paddr, elf + offset, filesz))
+            return false;
+    }
+
+    return true;
+}
+
+bool FlashImage::place(quint64 address, const char *data, quint32 size)
+{
+    if (address >= m_fuseAddress && address + size <= quint64(m_fuseAddress) + static_cast<quint32>(m_fuses.size()))
+    {
+        memcpy(m_fuses.data() + (address - m_fuseAddress), data, size);
+        memset(m_fusesSet.data() + (address - m_fuseAddress), 1, size);
+        return true;
+    }
+
+    const quint64 end = quint64(m_start) + static_cast<quint32>(m_data.size());
+    if (address + size <= m_start || address >= end)
+        return true;
+
+    if (address < m_start || address + size > end)
+        return fail(QString("Data at 0x%1 doesn't fit in the flash").arg(address, 0, 16));
+
+    memcpy(m_data.data() + (address - m_start), data, size);
+    return true;
+}
+
+bool FlashImage::fail(const QString &error)
+{
+    m_error = QString("%1: %2").arg(m_fileName, error);
+    qDebug() << m_error;
+    return false;
+}
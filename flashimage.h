@@ -0,0 +1,55 @@
+#ifndef FLASHIMAGE_H
+#define FLASHIMAGE_H
+
+#include <QString>
+#include <QByteArray>
+
+// The flash contents a device ends up with once HEX or ELF files have been
+// programmed into it, padded with erased (0xFF) bytes to the full flash size.
+// Used to work out offline what the device's CRC scan of its flash gives,
+// so that can be checked instead of reading the whole flash back.
+class FlashImage
+{
+public:
+    // start and size of the device's flash, as in its ATDF
+    FlashImage(quint32 start, quint32 size);
+
+    // Intel HEX or ELF (the PT_LOAD program headers at their load address).
+    // Data for other memories (EEPROM, fuses, ...) is left out, data that
+    // runs past the end of the flash is an error.
+    bool add(const QString &fileName);
+
+    // Also keeps the size bytes the files have at address for the fuses,
+    // call before add()
+    void setFuses(quint32 address, quint32 size);
+    // The fuse byte at offset, false if no file had one
+    bool fuse(quint32 offset, quint8 *value) const;
+
+    QString errorString() const { return m_error; }
+
+    const QByteArray &data() const { return m_data; }
+
+    // The two checksums the CRCSCAN peripheral can compute over the whole
+    // flash: CRC-16/CCITT-FALSE and CRC-32 (IEEE 802.3)
+    quint16 crc16() const;
+    quint32 crc32() const;
+
+    // Where the expected value is kept, next to the production file
+    static QString crcScanFile(const QString &fileName);
+
+private:
+    bool addHex(const QByteArray &contents);
+    bool addElf(const QByteArray &contents);
+    bool place(quint64 address, const char *data, quint32 size);
+    bool fail(const QString &error);
+
+    quint32 m_start;
+    QByteArray m_data;
+    quint32 m_fuseAddress;
+    QByteArray m_fuses;
+    QByteArray m_fusesSet;
+    QString m_fileName;
+    QString m_error;
+};
+
+#endif // FLASHIMAGE_H
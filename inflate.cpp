@@ -0,0 +1,327 @@
+#include "inflate.h"
+
+#include <cstring>
+
+// A straightforward canonical Huffman decoder in the style of zlib's puff.c.
+// The manifests and device files it is used for are small enough that the
+// simplicity is worth more than table driven speed.
+
+enum { MaxBits = 15, MaxLengthCodes = 286, MaxDistanceCodes = 30, MaxCodes = MaxLengthCodes + MaxDistanceCodes };
+
+struct Huffman
+{
+    short count[MaxBits + 1];   // Number of codes of each length
+    short symbol[MaxCodes];     // Symbols ordered by code
+};
+
+struct State
+{
+    const unsigned char *in;
+    size_t inSize;
+    size_t inPos;
+    unsigned char *out;
+    size_t outSize;
+    size_t outPos;
+    unsigned int bitBuffer;
+    int bitCount;
+    bool error;
+};
+
+static int bits(State *s, int need)
+{
+    unsigned int value = s->bitBuffer;
+    while (s->bitCount < need)
+    {
+        if (s->inPos == s->inSize)
+        {
+            s->error = true;
+            return 0;
+        }
+        value |= static_cast<unsigned int>(s->in[s->inPos++]) << s->bitCount;
+        s->bitCount += 8;
+    }
+
+    s->bitBuffer = value >> need;
+    s->bitCount -= need;
+    return static_cast<int>(value & ((1u << need) - 1));
+}
+
+static bool stored(State *s)
+{
+    // Stored blocks start on a byte boundary
+    s->bitBuffer = 0;
+    s->bitCount = 0;
+
+    if (s->inPos + 4 > s->inSize)
+        return false;
+
+    unsigned int length = s->in[s->inPos] | (s->in[s->inPos + 1] << 8);
+    unsigned int complement = s->in[s->inPos + 2] | (s->in[s->inPos + 3] << 8);
+    s->inPos += 4;
+    if (length != (~complement & 0xffff))
+        return false;
+
+    if (s->inPos + length > s->inSize || s->outPos + length > s->outSize)
+        return false;
+
+    memcpy(s->out + s->outPos, s->in + s->inPos, length);
+    s->inPos += length;
+    s->outPos += length;
+    return true;
+}
+
+static int decode(State *s, const Huffman *h)
+{
+    int code = 0;   // Bits read so far
+    int first = 0;  // First code of the current length
+    int index = 0;  // Index of the first code of the current length in symbol[]
+
+    for (int len = 1; len <= MaxBits; ++len)
+    {
+        code |= bits(s, 1);
+        if (s->error)
+            return -1;
+
+        int count = h->count[len];
+        if (code - count < first)
+            return h->symbol[index + (code - first)];
+
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+// Returns false for over-subscribed code sets. Incomplete sets are allowed,
+// the decoder just never matches the missing codes.
+static bool construct(Huffman *h, const short *length, int n)
+{
+    memset(h->count, 0, sizeof(h->count));
+    for (int symbol = 0; symbol < n; ++symbol)
+        ++h->count[length[symbol]];
+
+    if (h->count[0] == n)
+        return true;
+
+    int left = 1;
+    for (int len = 1; len <= MaxBits; ++len)
+    {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0)
+            return false;
+    }
+
+    short offsets[MaxBits + 1];
+    offsets[1] = 0;
+    for (int len = 1; len < MaxBits; ++len)
+        offsets[len + 1] = static_cast<short>(offsets[len] + h->count[len]);
+
+    for (int symbol = 0; symbol < n; ++symbol)
+    {
+        if (length[symbol] != 0)
+            h->symbol[offsets[length[symbol]]++] = static_cast<short>(symbol);
+    }
+
+    return true;
+}
+
+static bool codes(State *s, const Huffman *lengthCode, const Huffman *distanceCode)
+{
+    static const short lengthBase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const short lengthExtra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const short distanceBase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577 };
+    static const short distanceExtra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    while (true)
+    {
+        int symbol = decode(s, lengthCode);
+        if (symbol < 0)
+            return false;
+
+        if (symbol < 256)
+        {
+            if (s->outPos == s->outSize)
+                return false;
+            s->out[s->outPos++] = static_cast<unsigned char>(symbol);
+        }
+        else if (symbol == 256)
+        {
+            return true;
+        }
+        else
+        {
+            symbol -= 257;
+            if (symbol >= 29)
+                return false;
+            size_t length = static_cast<size_t>(lengthBase[symbol] + bits(s, lengthExtra[symbol]));
+
+            symbol = decode(s, distanceCode);
+            if (symbol < 0 || symbol >= 30)
+                return false;
+            size_t distance = static_cast<size_t>(distanceBase[symbol] + bits(s, distanceExtra[symbol]));
+
+            if (s->error || distance > s->outPos || s->outPos + length > s->outSize)
+                return false;
+
+            // Byte by byte, the source and destination may overlap
+            unsigned char *to = s->out + s->outPos;
+            const unsigned char *from = to - distance;
+            for (size_t i = 0; i < length; ++i)
+                to[i] = from[i];
+            s->outPos += length;
+        }
+    }
+}
+
+// The codes of fixed Huffman blocks never change
+struct FixedCodes
+{
+    Huffman lengthCode;
+    Huffman distanceCode;
+
+    FixedCodes()
+    {
+        short lengths[288];
+        int symbol = 0;
+        for (; symbol < 144; ++symbol) lengths[symbol] = 8;
+        for (; symbol < 256; ++symbol) lengths[symbol] = 9;
+        for (; symbol < 280; ++symbol) lengths[symbol] = 7;
+        for (; symbol < 288; ++symbol) lengths[symbol] = 8;
+        construct(&lengthCode, lengths, 288);
+
+        for (symbol = 0; symbol < 30; ++symbol)
+            lengths[symbol] = 5;
+        construct(&distanceCode, lengths, 30);
+    }
+};
+
+static bool fixed(State *s)
+{
+    // Manifests are inflated on several threads at once, a local static is
+    // built exactly once no matter which of them gets here first
+    static const FixedCodes fixedCodes;
+    return codes(s, &fixedCodes.lengthCode, &fixedCodes.distanceCode);
+}
+
+static bool dynamic(State *s)
+{
+    static const short order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    int lengthCount = bits(s, 5) + 257;
+    int distanceCount = bits(s, 5) + 1;
+    int codeCount = bits(s, 4) + 4;
+    if (s->error || lengthCount > MaxLengthCodes || distanceCount > MaxDistanceCodes)
+        return false;
+
+    short lengths[MaxCodes];
+    int index = 0;
+    for (; index < codeCount; ++index)
+        lengths[order[index]] = static_cast<short>(bits(s, 3));
+    for (; index < 19; ++index)
+        lengths[order[index]] = 0;
+    if (s->error)
+        return false;
+
+    Huffman lengthCode, distanceCode;
+    if (!construct(&lengthCode, lengths, 19))
+        return false;
+
+    index = 0;
+    while (index < lengthCount + distanceCount)
+    {
+        int symbol = decode(s, &lengthCode);
+        if (symbol < 0)
+            return false;
+
+        if (symbol < 16)
+        {
+            lengths[index++] = static_cast<short>(symbol);
+            continue;
+        }
+
+        short length = 0;
+        int repeat;
+        if (symbol == 16)
+        {
+            if (index == 0)
+                return false;
+            length = lengths[index - 1];
+            repeat = 3 + bits(s, 2);
+        }
+        else if (symbol == 17)
+        {
+            repeat = 3 + bits(s, 3);
+        }
+        else
+        {
+            repeat = 11 + bits(s, 7);
+        }
+
+        if (s->error || index + repeat > lengthCount + distanceCount)
+            return false;
+        while (repeat--)
+            lengths[index++] = length;
+    }
+
+    // Without an end of block code the block could never finish
+    if (lengths[256] == 0)
+        return false;
+
+    if (!construct(&lengthCode, lengths, lengthCount) ||
+        !construct(&distanceCode, lengths + lengthCount, distanceCount))
+    {
+        return false;
+    }
+
+    return codes(s, &lengthCode, &distanceCode);
+}
+
+bool inflateRaw(const unsigned char *in, size_t inSize, unsigned char *out, size_t outSize)
+{
+    State s;
+    s.in = in;
+    s.inSize = inSize;
+    s.inPos = 0;
+    s.out = out;
+    s.outSize = outSize;
+    s.outPos = 0;
+    s.bitBuffer = 0;
+    s.bitCount = 0;
+    s.error = false;
+
+    int last;
+    do
+    {
+        last = bits(&s, 1);
+        int type = bits(&s, 2);
+        if (s.error)
+            return false;
+
+        bool ok;
+        switch (type)
+        {
+        case 0:  ok = stored(&s);  break;
+        case 1:  ok = fixed(&s);   break;
+        case 2:  ok = dynamic(&s); break;
+        default: ok = false;       break;
+        }
+
+        if (!ok || s.error)
+            return false;
+    } while (!last);
+
+    return s.outPos == s.outSize;
+}
@@ -0,0 +1,12 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <cstddef>
+
+// Decoder for raw DEFLATE streams (RFC 1951), the compression used inside
+// zip based .atpack archives. Qt's qUncompress only takes zlib wrapped data.
+// Decodes all of in into out, which has to be exactly the uncompressed size
+// (zip archives record it). Returns false on corrupt or truncated input.
+bool inflateRaw(const unsigned char *in, size_t inSize, unsigned char *out, size_t outSize);
+
+#endif // INFLATE_H
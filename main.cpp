@@ -1,11 +1,65 @@
 #include "mainwindow.h"
+#include "deviceindex.h"
+#include "startuptrace.h"
+#include <QDebug>
 #include <QApplication>
+#include <QScopedPointer>
+#include <QCommandLineParser>
+
+// The installer builds the index on machines that may have no display,
+// which a QApplication refuses to start without
+static QCoreApplication *createApplication(int &argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (qstrcmp(argv[i], "--build-index") == 0 || qstrncmp(argv[i], "--build-index=", 14) == 0)
+            return new QCoreApplication(argc, argv);
+    }
+    return new QApplication(argc, argv);
+}
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
+    StartupTrace::start();
+    QScopedPointer<QCoreApplication> a(createApplication(argc, argv));
+    StartupTrace::mark("application");
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption buildIndex("build-index",
+                                  "Generate the device index for the packs in <packs> and exit. "
+                                  "Run by the installer whenever packs are installed or updated.",
+                                  "packs");
+    QCommandLineOption traceStartup("trace-startup",
+                                    "Write the startup phase timings to <file> as JSON. "
+                                    "The ATPROGRAM_GUI_TRACE environment variable does the same.",
+                                    "file");
+    parser.addOption(buildIndex);
+    parser.addOption(traceStartup);
+    parser.process(*a);
+
+    if (parser.isSet(traceStartup))
+        StartupTrace::setFile(parser.value(traceStartup));
+
+    if (parser.isSet(buildIndex))
+    {
+        QString error;
+        QString packsDir = parser.value(buildIndex);
+        if (!DeviceIndex::build(packsDir, DeviceIndex::defaultFile(packsDir), &error))
+        {
+            qCritical() << error;
+            return 1;
+        }
+        return 0;
+    }
+
+    StartupTrace::watchFirstPaint();
     MainWindow w;
+    StartupTrace::mark("main window");
     w.show();
+    StartupTrace::mark("show");
 
-    return a.exec();
+    int result = a->exec();
+    StartupTrace::write();
+    return result;
 }
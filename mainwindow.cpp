@@ -1,7 +1,10 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
-#include "tinyxml2.h"
+#include "packscanner.h"
+#include "targetmodel.h"
+#include "startuptrace.h"
 #include "crc32.h"
+#include "flashimage.h"
 
 #include <QTimer>
 #include <QDebug>
@@ -10,15 +13,24 @@
 #include <QCompleter>
 #include <QFileDialog>
 #include <QMessageBox>
-#include <QDirIterator>
 #include <QMimeData>
 #include <QStandardPaths>
+#include <QStringListModel>
 
 QString DEFAULT_BOOT_DIR;
 QString DEFAULT_APP_DIR;
 
 static const QString k_programName = "atprogram.exe";
 
+// Rows in the target search popup
+static const int k_targetSearchResults = 50;
+
+// Upper bound in bytes for the parsed ATDF descriptors kept around
+static const int k_deviceCacheSize = 1024 * 1024;
+
+// Where the AVR toolchains put the fuses in HEX and ELF files
+static const quint32 k_fuseAddress = 0x820000;
+
 static const QStringList k_programmers = QStringList()
         << "avrdragon"
         << "avrispmk2"
@@ -53,9 +65,17 @@ MainWindow::MainWindow(QWidget *parent) :
     ui(new Ui::MainWindow),
     m_running(false),
     m_showPfileWarning(true),
-    m_process(new QProcess(this))
+    m_process(new QProcess(this)),
+    m_scanThread(nullptr),
+    m_scanner(nullptr),
+    m_targetModel(new TargetModel(this)),
+    m_targetIndexDirty(true),
+    m_searchModel(new QStringListModel(this))
 {
+    m_devices.setMaxCost(k_deviceCacheSize);
+
     ui->setupUi(this);
+    StartupTrace::mark("setupUi");
     ui->programmerComboBox->addItems(k_programmers);
     ui->interfaceComboBox->addItems(k_interfaces);
 
@@ -79,42 +99,53 @@ MainWindow::MainWindow(QWidget *parent) :
         ui->commandOutput->append(QString("Using atbackend from %1").arg(atprogram.canonicalPath()));
         found = true;
     }
+    StartupTrace::mark("atbackend lookup");
 
     if (found)
     {
-        QStringList targetList;
-        QString packsDir = atprogram.canonicalPath() + "/../packs";
-        QDirIterator it(packsDir, QStringList() << "package.content", QDir::NoFilter, QDirIterator::Subdirectories);
-        while (it.hasNext())
+        QString packsDir = QDir::cleanPath(atprogram.canonicalPath() + "/../packs");
+
+        // A device index generated at install time replaces the pack scan. Whether
+        // packs were installed, updated or removed since it was built is checked
+        // on the scanner thread, so all startup does with it is map the file.
+        bool useIndex = m_deviceIndex.open(DeviceIndex::defaultFile(packsDir));
+        QStringList indexTargets;
+        if (useIndex)
         {
-            // QXmlStreamReader didn't like the ASCII encoding used in the package.content files
-            using namespace tinyxml2;
-            XMLDocument doc;
-            std::string fileName = it.next().toStdString();
-            if (doc.LoadFile(fileName.c_str()) == XML_SUCCESS)
-            {
-                XMLElement *e = nullptr;
-                if ((e = doc.FirstChildElement("package")))
-                {
-                    if ((e = e->FirstChildElement("content")))
-                    {
-                        for (e = e->FirstChildElement("resources"); e; e = e->NextSiblingElement("resources"))
-                        {
-                            QString attr(e->Attribute("target"));
-                            if (!attr.isEmpty())
-                            {
-                                targetList.append(attr);
-                                ui->targetComboBox->addItem(attr);
-                            }
-                        }
-                    }
-                }
-            }
+            indexTargets = m_deviceIndex.targets();
+            m_targetModel->setTargets(indexTargets);
+            ui->commandOutput->append(QString("Using device index with %1 targets").arg(m_deviceIndex.count()));
+            StartupTrace::count("index targets", m_deviceIndex.count());
+            StartupTrace::mark("device index");
         }
 
-        QCompleter *completer = new QCompleter(targetList, this);
-        completer->setCaseSensitivity(Qt::CaseInsensitive);
-        ui->targetComboBox->setCompleter(completer);
+        // Scan on a worker thread, targets are added as they are found. The thread
+        // keeps running afterwards to watch for pack changes, with a current index
+        // it only does the watching.
+        m_scanThread = new QThread(this);
+        m_scanner = new PackScanner(packsDir, PackCatalog::defaultCacheFile());
+        if (useIndex)
+            m_scanner->setIndex(m_deviceIndex.fingerprint(), indexTargets);
+        m_scanner->moveToThread(m_scanThread);
+        connect(m_scanThread, &QThread::started, m_scanner, useIndex ? &PackScanner::monitor : &PackScanner::scan);
+        connect(m_scanner, &PackScanner::targetsFound, this, &MainWindow::on_targetsFound);
+        connect(m_scanner, &PackScanner::finished, this, &MainWindow::on_scanFinished);
+        connect(m_scanner, &PackScanner::targetsChanged, this, &MainWindow::on_targetsChanged);
+        connect(m_scanner, &PackScanner::indexStale, this, &MainWindow::on_indexStale);
+
+        // The combo box lists every target, the completer pops up the best
+        // matches from the search index while the operator types.
+        // Set on the line edit so the combo box doesn't map completer rows onto its own model.
+        ui->targetComboBox->setModel(m_targetModel);
+        QCompleter *completer = new QCompleter(m_searchModel, this);
+        completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+        ui->targetComboBox->lineEdit()->setCompleter(completer);
+        connect(ui->targetComboBox->lineEdit(), &QLineEdit::textEdited, this, &MainWindow::on_targetEdited);
+
+        // The index is rebuilt on the next search
+        connect(m_targetModel, &QAbstractItemModel::modelReset, this, [this]() { m_targetIndexDirty = true; });
+        connect(m_targetModel, &QAbstractItemModel::rowsInserted, this, [this]() { m_targetIndexDirty = true; });
+        connect(m_targetModel, &QAbstractItemModel::rowsRemoved, this, [this]() { m_targetIndexDirty = true; });
 
         m_process->setProgram(atprogram.canonicalFilePath());
         m_process->setWorkingDirectory(atprogram.canonicalPath());
@@ -133,23 +164,40 @@ MainWindow::MainWindow(QWidget *parent) :
     m_showPfileWarning =                        settings.value("showPfileWarning", true).toBool();
 
     ui->showDebug           ->setChecked(       settings.value("showDebug" , true).toBool());
+    ui->pskipReadback       ->setChecked(       settings.value("skipReadback", false).toBool());
     ui->programmerComboBox  ->setCurrentText(   settings.value("programmer", "atmelice").toString());
     ui->interfaceComboBox   ->setCurrentText(   settings.value("interface" , "UPDI").toString());
     ui->targetComboBox      ->setCurrentText(   settings.value("target"    , "AVR128DB48").toString());
     ui->pBootEdit           ->setText(          settings.value("bootDir"   , QStandardPaths::locate(QStandardPaths::DesktopLocation, "")).toString());
     ui->pAppEdit            ->setText(          settings.value("appDir"    , QStandardPaths::locate(QStandardPaths::DesktopLocation, "")).toString());
 
+    m_recentTargets = settings.value("recentTargets").toStringList();
+    m_targetIndex.setRecent(m_recentTargets);
+
     DEFAULT_BOOT_DIR = settings.value("bootDir").toString();
     DEFAULT_APP_DIR  = settings.value("appDir" ).toString();
 
     ui->commandOutput->setVisible(ui->showDebug->isChecked());
+    StartupTrace::mark("settings restore");
 
     ui->commandOutput->append(QString("Using program %1").arg(m_process->program()));
     ui->commandOutput->append(QString("Using working directory %1").arg(m_process->workingDirectory()));
+
+    // Started last so the restored target is already in place when the first batch arrives
+    if (m_scanThread)
+        m_scanThread->start();
 }
 
 MainWindow::~MainWindow()
 {
+    if (m_scanThread)
+    {
+        m_scanner->cancel();
+        m_scanThread->quit();
+        m_scanThread->wait();
+        delete m_scanner;
+    }
+
     delete ui;
 }
 
@@ -163,9 +211,11 @@ void MainWindow::closeEvent(QCloseEvent *)
     settings.setValue("geometry", this->saveGeometry());
     settings.setValue("showPfileWarning", m_showPfileWarning);
     settings.setValue("showDebug", ui->showDebug->isChecked());
+    settings.setValue("skipReadback", ui->pskipReadback->isChecked());
     settings.setValue("programmer", ui->programmerComboBox->currentText());
     settings.setValue("interface", ui->interfaceComboBox->currentText());
     settings.setValue("target", ui->targetComboBox->currentText());
+    settings.setValue("recentTargets", m_recentTargets);
     settings.setValue("bootDir", ui->pBootEdit->text());
     settings.setValue("appDir", ui->pAppEdit->text());
 }
@@ -275,6 +325,76 @@ void MainWindow::on_processFinished(int exitCode)
         startProcess(m_commandQueue.dequeue());
 }
 
+void MainWindow::on_targetsFound(const QStringList &targets)
+{
+    // Filling an empty combo box selects index 0, keep whatever was restored or typed instead
+    QString current = ui->targetComboBox->currentText();
+    m_targetModel->addTargets(targets);
+    if (ui->targetComboBox->currentText() != current)
+        ui->targetComboBox->setCurrentText(current);
+}
+
+void MainWindow::on_scanFinished(int count)
+{
+    ui->commandOutput->append(QString("Found %1 targets").arg(count));
+}
+
+void MainWindow::on_targetsChanged(const QStringList &added, const QStringList &removed)
+{
+    QString current = ui->targetComboBox->currentText();
+    m_targetModel->addTargets(added);
+    m_targetModel->removeTargets(removed);
+    if (ui->targetComboBox->currentText() != current)
+        ui->targetComboBox->setCurrentText(current);
+
+    // Updated packs may come with updated device files, and the device index
+    // no longer matches the packs, the scanner knows where everything is now
+    m_devices.clear();
+    m_deviceIndex.close();
+
+    ui->commandOutput->append(QString("Packs changed: %1 targets added, %2 removed")
+                              .arg(added.size()).arg(removed.size()));
+}
+
+void MainWindow::on_indexStale()
+{
+    // The target list has already been patched through on_targetsChanged(),
+    // the segments and fuses now come from the device files
+    m_devices.clear();
+    m_deviceIndex.close();
+
+    ui->commandOutput->append("Packs changed since the device index was built, using the packs instead");
+}
+
+void MainWindow::on_targetEdited(const QString &text)
+{
+    if (m_targetIndexDirty)
+    {
+        m_targetIndex.build(m_targetModel->targets());
+        m_targetIndexDirty = false;
+    }
+
+    // The line edit pops the completer up with these right after this returns
+    m_searchModel->setStringList(m_targetIndex.search(text, k_targetSearchResults));
+}
+
+void MainWindow::on_targetComboBox_currentTextChanged(const QString &target)
+{
+    // Only complete target names, not every keystroke in between
+    if (!m_targetModel->contains(target))
+        return;
+
+    const DeviceDescriptor *descriptor = device(target);
+    if (!descriptor)
+        return;
+
+    ui->commandOutput->append(descriptor->summary());
+
+    QString interface = ui->interfaceComboBox->currentText();
+    if (!descriptor->interfaces.isEmpty() && !descriptor->supportsInterface(interface))
+        ui->commandOutput->append(QString("Warning: %1 does not support %2").arg(target, interface));
+}
+
 void MainWindow::on_flashBrowse_clicked()
 {
     QString fileName = QFileDialog::getOpenFileName(this, "Open File",
@@ -454,6 +574,9 @@ void MainWindow::on_startButton_clicked()
                  proceed = true;
 
             QStringList args;
+            // Files of a run that may skip the readback, and where its --verify goes otherwise
+            QStringList crcScanFiles;
+            int verifyAt = -1;
 
             args << "-v"
                  << "-t" << programmer
@@ -468,6 +591,9 @@ void MainWindow::on_startButton_clicked()
                 // Flash bootloader at the end since by default, the bootloader also sets the fuses and lock bits
                 // program the full contents of both production files but only verify application code, since boot code will
                 // lock the device and prevent verification code
+                if (ui->pskipReadback->isChecked())
+                    ui->commandOutput->append("Both files are programmed in full, keeping the readback verify");
+
                 args << "--verify"
                      << "-f" << ui->pAppEdit->text()
                      << "program"
@@ -476,33 +602,51 @@ void MainWindow::on_startButton_clicked()
             // Otherwise only flash the given file
             else
             {
-                args << "--verify"
-                     << "-f" << ((bootFileInfo.isFile()) ? (ui->pBootEdit->text()) : (ui->pAppEdit->text()));
+                QString fileName = (bootFileInfo.isFile()) ? (ui->pBootEdit->text()) : (ui->pAppEdit->text());
+                QStringList memories;
 
                 if (ui->pfileFuses->isEnabled() && (ui->pfileFuses->isChecked()))
                 {
-                    args << "-fs";
+                    memories << "-fs";
                     warn = false;
                 }
 
                 if (ui->pfileFlash->isEnabled() && ui->pfileFlash->isChecked())
                 {
-                    args << "-fl";
+                    memories << "-fl";
                     warn = false;
                 }
 
                 if (ui->pfileEeprom->isEnabled() && ui->pfileEeprom->isChecked())
                 {
-                    args << "-ee";
+                    memories << "-ee";
                     warn = false;
                 }
 
                 if (ui->plockDevice->isEnabled() && ui->plockDevice->isChecked())
                 {
                     //args << "-lb --values A33A3AA3";
-                    args << "-lb";
+                    memories << "-lb";
                     warn = false;
                 }
+
+                // A CRC scan only vouches for the flash, so the readback is only skipped when
+                // nothing else gets written. Nothing selected means all of the file.
+                if (ui->pskipReadback->isChecked())
+                {
+                    if (memories == QStringList("-fl"))
+                    {
+                        crcScanFiles << fileName;
+                        verifyAt = args.size();
+                    }
+                    else
+                        ui->commandOutput->append("Not only flash is programmed, keeping the readback verify");
+                }
+
+                if (crcScanFiles.isEmpty())
+                    args << "--verify";
+
+                args << "-f" << fileName << memories;
             }
 
             if ((warn == true) && (bootApp == false))
@@ -526,7 +670,14 @@ void MainWindow::on_startButton_clicked()
                 }
             }
 
-            if (proceed) m_commandQueue.enqueue(args);
+            if (proceed)
+            {
+                // Only now that the run goes ahead, so a cancelled one leaves no CRC behind
+                if (!crcScanFiles.isEmpty() && !prepareCrcScan(crcScanFiles))
+                    args.insert(verifyAt, "--verify");
+
+                m_commandQueue.enqueue(args);
+            }
         }
         else
         {
@@ -542,6 +693,7 @@ void MainWindow::on_startButton_clicked()
         ui->flashGroup->setChecked(false);
         ui->eepromGroup->setChecked(false);
         startProcess(m_commandQueue.dequeue());
+        addRecentTarget(ui->targetComboBox->currentText());
         ui->progressBar->setFormat("Loading...");
         ui->statusBar->clearMessage();
     }
@@ -577,6 +729,130 @@ void MainWindow::startProcess(const QStringList& args)
     m_process->start();
 }
 
+void MainWindow::addRecentTarget(const QString &target)
+{
+    m_recentTargets.removeAll(target);
+    m_recentTargets.prepend(target);
+    while (m_recentTargets.size() > TargetIndex::k_maxRecent)
+        m_recentTargets.removeLast();
+
+    m_targetIndex.setRecent(m_recentTargets);
+}
+
+const DeviceDescriptor *MainWindow::device(const QString &target)
+{
+    DeviceDescriptor *descriptor = m_devices.object(target);
+    if (descriptor)
+        return descriptor;
+
+    bool loaded = false;
+    descriptor = new DeviceDescriptor;
+    if (m_deviceIndex.isOpen())
+        loaded = m_deviceIndex.descriptor(target, descriptor);
+
+    // Packs installed while running aren't in the index
+    if (!loaded && m_scanner)
+    {
+        QString packDir = m_scanner->packDir(target);
+        loaded = !packDir.isEmpty() && descriptor->load(packDir, target);
+    }
+
+    if (!loaded)
+    {
+        delete descriptor;
+        return nullptr;
+    }
+
+    // QCache takes ownership, and deletes it right away if it can never fit
+    if (!m_devices.insert(target, descriptor, descriptor->cost()))
+        return nullptr;
+
+    return descriptor;
+}
+
+// Works out what the device's CRC scan of its flash should give once files
+// are programmed and saves it next to the last one. Only AVR8X devices have
+// the CRCSCAN peripheral, and what it scans is set by fuses (SYSCFG0 on the
+// AVR Dx/Ex): CRCSRC has to be FLASH, as a scan of the boot or application
+// section alone says nothing about the rest, and CRCSEL picks CRC-16 or
+// CRC-32. This run only writes the flash, so those are read from the fuses
+// in the files. Returns false if any of that can't be done, the readback
+// verify has to stay then.
+bool MainWindow::prepareCrcScan(const QStringList &files)
+{
+    const QString target = ui->targetComboBox->currentText();
+    const DeviceDescriptor *descriptor = device(target);
+    if (!descriptor || descriptor->architecture.compare("AVR8X", Qt::CaseInsensitive) != 0 ||
+        !descriptor->hasPeripheral("CRCSCAN"))
+    {
+        ui->commandOutput->append(QString("%1 has no CRC scan, verifying by readback").arg(target));
+        return false;
+    }
+
+    const DeviceDescriptor::MemorySegment *flash = descriptor->segment("flash");
+    quint32 sourceMask = 0, selectMask = 0;
+    const DeviceDescriptor::FuseRegister *source = descriptor->fuse("CRCSRC", &sourceMask);
+    const DeviceDescriptor::FuseRegister *select = descriptor->fuse("CRCSEL", &selectMask);
+    if (!flash || !source || !sourceMask)
+    {
+        ui->commandOutput->append(QString("Flash or CRC scan fuses of %1 unknown, verifying by readback").arg(target));
+        return false;
+    }
+
+    quint32 fuseSize = 0;
+    foreach (const DeviceDescriptor::FuseRegister &fuse, descriptor->fuses)
+        fuseSize = qMax(fuseSize, fuse.offset + fuse.size);
+
+    FlashImage image(flash->start, flash->size);
+    image.setFuses(k_fuseAddress, fuseSize);
+    foreach (const QString &file, files)
+    {
+        if (!image.add(file))
+        {
+            ui->commandOutput->append(image.errorString() + ", verifying by readback");
+            return false;
+        }
+    }
+
+    // CRCSRC is 0 for FLASH, then BOOT, BOOTAPP and NOCRC. CRCSEL is 0 for CRC-16, 1 for CRC-32.
+    quint8 sourceValue = 0, selectValue = 0;
+    if (!image.fuse(source->offset, &sourceValue) || (select && !image.fuse(select->offset, &selectValue)))
+    {
+        ui->commandOutput->append(QString("No %1 fuse in the files, the CRC scan of %2 is unknown, verifying by readback")
+                                  .arg(source->name, target));
+        return false;
+    }
+
+    if (sourceValue & sourceMask)
+    {
+        ui->commandOutput->append(QString("%1 fuse 0x%2 doesn't have the CRC scan cover all of the flash, verifying by readback")
+                                  .arg(source->name).arg(sourceValue, 2, 16, QChar('0')));
+        return false;
+    }
+
+    const bool crc32 = select && (selectValue & selectMask);
+    QString algorithm = crc32 ? "CRC-32" : "CRC-16/CCITT-FALSE";
+    QString crc = crc32 ? QString("%1").arg(image.crc32(), 8, 16, QChar('0')).toUpper()
+                        : QString("%1").arg(image.crc16(), 4, 16, QChar('0')).toUpper();
+
+    QSettings sidecar(FlashImage::crcScanFile(files.last()), QSettings::IniFormat);
+    sidecar.clear();
+    sidecar.setValue("target", target);
+    sidecar.setValue("files", files);
+    sidecar.setValue("flashStart", QString::number(flash->start, 16));
+    sidecar.setValue("flashSize", QString::number(flash->size, 16));
+    sidecar.setValue(source->name, QString::number(sourceValue, 16));
+    sidecar.setValue("algorithm", algorithm);
+    sidecar.setValue("crc", crc);
+    sidecar.sync();
+    if (sidecar.status() != QSettings::NoError)
+        ui->commandOutput->append(QString("Failed to save %1").arg(sidecar.fileName()));
+
+    ui->commandOutput->append(QString("Flash is NOT verified on this run, the %1 CRC scan of it should give %2 (saved to %3)")
+                              .arg(target, crc, sidecar.fileName()));
+    return true;
+}
+
 bool MainWindow::getElfSections(const QString &fileName, QStringList &sections)
 {
     //FIXME: this is not working for AVR elf files
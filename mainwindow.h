@@ -1,11 +1,20 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QCache>
 #include <QQueue>
+#include <QThread>
 #include <QProcess>
 #include <QDropEvent>
 #include <QMainWindow>
 
+#include "targetindex.h"
+#include "deviceindex.h"
+
+class QStringListModel;
+class PackScanner;
+class TargetModel;
+
 namespace Ui {
 class MainWindow;
 }
@@ -38,6 +47,12 @@ private slots:
     void on_showDebug_toggled(bool checked);
     void on_pAppBrowse_clicked();
     void on_pBootBrowse_clicked();
+    void on_targetsFound(const QStringList& targets);
+    void on_scanFinished(int count);
+    void on_targetsChanged(const QStringList& added, const QStringList& removed);
+    void on_indexStale();
+    void on_targetEdited(const QString& text);
+    void on_targetComboBox_currentTextChanged(const QString& target);
 
 private:
     Ui::MainWindow *ui;
@@ -45,10 +60,22 @@ private:
     bool m_showPfileWarning;
     QProcess *m_process;
     QQueue<QStringList> m_commandQueue;
+    QThread *m_scanThread;
+    PackScanner *m_scanner;
+    TargetModel *m_targetModel;
+    TargetIndex m_targetIndex;
+    bool m_targetIndexDirty;
+    QStringListModel *m_searchModel;
+    QStringList m_recentTargets;
+    QCache<QString, DeviceDescriptor> m_devices;
+    DeviceIndex m_deviceIndex;
 
     void setRunning(bool running);
     void startProcess(const QStringList& args);
+    void addRecentTarget(const QString& target);
+    const DeviceDescriptor *device(const QString& target);
     bool getElfSections(const QString& fileName, QStringList &sections);
+    bool prepareCrcScan(const QStringList& files);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,313 @@
+#include "packcatalog.h"
+#include "atpackarchive.h"
+#include "packmanifest.h"
+#include "tinyxml2.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QMap>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QVersionNumber>
+#include <QRegularExpression>
+#include <QStandardPaths>
+
+// Bump k_cacheVersion whenever the on-disk layout or the parse rules change
+// so stale caches are thrown away instead of misread.
+static const quint32 k_cacheMagic   = 0x41545043; // "ATPC"
+static const quint32 k_cacheVersion = 1;
+
+PackCatalog::PackCatalog() :
+    m_dirty(false)
+{
+}
+
+QString PackCatalog::defaultCacheFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+            + "/RuggedScience/atprogram-gui/targets.cache";
+}
+
+bool PackCatalog::load(const QString &fileName)
+{
+    m_entries.clear();
+    m_dirty = true;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0, version = 0, count = 0;
+    in >> magic >> version >> count;
+    if (magic != k_cacheMagic || version != k_cacheVersion)
+    {
+        qDebug() << "Ignoring outdated target cache" << fileName;
+        return false;
+    }
+
+    QHash<QString, Entry> entries;
+    entries.reserve(static_cast<int>(count));
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        QString path;
+        Entry entry;
+        in >> path >> entry.size >> entry.modified >> entry.targets;
+        entries.insert(path, entry);
+    }
+
+    if (in.status() != QDataStream::Ok)
+    {
+        qDebug() << "Ignoring corrupt target cache" << fileName;
+        return false;
+    }
+
+    m_entries = entries;
+    m_dirty = false;
+    return true;
+}
+
+bool PackCatalog::save(const QString &fileName) const
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    // QSaveFile so a crash mid-write never leaves a truncated cache behind
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qDebug() << file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << k_cacheMagic << k_cacheVersion << static_cast<quint32>(m_entries.size());
+
+    QHash<QString, Entry>::const_iterator it;
+    for (it = m_entries.constBegin(); it != m_entries.constEnd(); ++it)
+        out << it.key() << it.value().size << it.value().modified << it.value().targets;
+
+    return file.commit();
+}
+
+void PackCatalog::beginScan()
+{
+    m_seen.clear();
+}
+
+bool PackCatalog::lookup(const QFileInfo &info, QStringList *targets)
+{
+    QString fileName = info.absoluteFilePath();
+    QHash<QString, Entry>::const_iterator cached = m_entries.constFind(fileName);
+    if (cached == m_entries.constEnd() ||
+        cached.value().size != info.size() ||
+        cached.value().modified != info.lastModified().toMSecsSinceEpoch())
+    {
+        return false;
+    }
+
+    m_seen.insert(fileName);
+    *targets = cached.value().targets;
+    return true;
+}
+
+void PackCatalog::insert(const QFileInfo &info, const QStringList &targets)
+{
+    Entry entry;
+    entry.size = info.size();
+    entry.modified = info.lastModified().toMSecsSinceEpoch();
+    entry.targets = targets;
+
+    QString fileName = info.absoluteFilePath();
+    m_entries.insert(fileName, entry);
+    m_seen.insert(fileName);
+    m_dirty = true;
+}
+
+void PackCatalog::endScan()
+{
+    QHash<QString, Entry>::iterator it = m_entries.begin();
+    while (it != m_entries.end())
+    {
+        if (m_seen.contains(it.key()))
+        {
+            ++it;
+        }
+        else
+        {
+            it = m_entries.erase(it);
+            m_dirty = true;
+        }
+    }
+    m_seen.clear();
+}
+
+QFileInfoList PackCatalog::findManifests(const QString &packsDir)
+{
+    struct Candidate
+    {
+        QFileInfo manifest;
+        QVersionNumber version;
+    };
+
+    // Keyed by vendor/pack so installed and archived versions compete
+    QMap<QString, Candidate> latest;
+
+    // Packs are installed as <vendor>/<pack>/<version>/package.content with every
+    // version side by side. Older versions would only add stale duplicates, and
+    // not recursing into the packs keeps the walk out of the include trees.
+    const QDir::Filters dirs = QDir::Dirs | QDir::NoDotAndDotDot;
+    foreach (const QFileInfo &vendor, QDir(packsDir).entryInfoList(dirs, QDir::Name))
+    {
+        foreach (const QFileInfo &pack, QDir(vendor.absoluteFilePath()).entryInfoList(dirs, QDir::Name))
+        {
+            QString key = vendor.fileName() + '/' + pack.fileName();
+
+            foreach (const QFileInfo &version, QDir(pack.absoluteFilePath()).entryInfoList(dirs, QDir::Name))
+            {
+                QFileInfo manifest(version.absoluteFilePath() + "/package.content");
+                if (!manifest.isFile())
+                    continue;
+
+                // Suffixes like "-rc1" are ignored, equal versions go to the last name
+                QVersionNumber number = QVersionNumber::fromString(version.fileName());
+                if (!latest.contains(key) || QVersionNumber::compare(number, latest.value(key).version) >= 0)
+                {
+                    Candidate candidate = { manifest, number };
+                    latest.insert(key, candidate);
+                }
+            }
+        }
+    }
+
+    // Archives are named <vendor>.<pack>.<version>.atpack the way Microchip
+    // publishes them. An installed copy of the same version wins, it is cheaper to read.
+    static const QRegularExpression archiveName("^([^.]+)\\.(.+?)\\.(\\d+(?:\\.\\d+)*)\\.atpack$",
+                                                QRegularExpression::CaseInsensitiveOption);
+    foreach (const QFileInfo &archive, QDir(packsDir).entryInfoList(QStringList("*.atpack"), QDir::Files, QDir::Name))
+    {
+        QString key = archive.completeBaseName();
+        QVersionNumber number;
+
+        QRegularExpressionMatch match = archiveName.match(archive.fileName());
+        if (match.hasMatch())
+        {
+            key = match.captured(1) + '/' + match.captured(2);
+            number = QVersionNumber::fromString(match.captured(3));
+        }
+
+        if (!latest.contains(key) || QVersionNumber::compare(number, latest.value(key).version) > 0)
+        {
+            Candidate candidate = { archive, number };
+            latest.insert(key, candidate);
+        }
+    }
+
+    QFileInfoList manifests;
+    foreach (const Candidate &candidate, latest)
+        manifests.append(candidate.manifest);
+
+    return manifests;
+}
+
+quint64 PackCatalog::fingerprint(const QString &packsDir, const QFileInfoList &manifests)
+{
+    QDir root(packsDir);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    foreach (const QFileInfo &manifest, manifests)
+    {
+        QByteArray record;
+        QDataStream out(&record, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+        out << root.relativeFilePath(manifest.absoluteFilePath()) << manifest.size()
+            << manifest.lastModified().toMSecsSinceEpoch();
+        hash.addData(record);
+    }
+
+    QByteArray digest = hash.result();
+    return qFromLittleEndian<quint64>(reinterpret_cast<const uchar *>(digest.constData()));
+}
+
+QString PackCatalog::packLocation(const QFileInfo &manifest)
+{
+    if (AtpackArchive::isArchive(manifest.fileName()))
+        return manifest.absoluteFilePath();
+
+    return manifest.absolutePath();
+}
+
+QStringList PackCatalog::parseManifest(const QString &fileName, tinyxml2::XMLDocument *doc, qint64 *bytes)
+{
+    QStringList targets;
+
+    QFile file;
+    QByteArray buffer;
+    const char *data = nullptr;
+    qint64 size = 0;
+
+    if (AtpackArchive::isArchive(fileName))
+    {
+        // Only the manifest is decompressed, the rest of the archive stays put
+        AtpackArchive archive;
+        if (!archive.open(fileName) || !archive.read("package.content", &buffer))
+            return targets;
+
+        data = buffer.constData();
+        size = buffer.size();
+    }
+    else
+    {
+        file.setFileName(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qDebug() << file.errorString();
+            return targets;
+        }
+
+        // Mapping saves a copy, a plain read is fine for the odd file that can't be mapped
+        size = file.size();
+        data = reinterpret_cast<const char *>(file.map(0, size));
+        if (!data)
+        {
+            buffer = file.readAll();
+            data = buffer.constData();
+            size = buffer.size();
+        }
+    }
+
+    if (bytes)
+        *bytes = size;
+
+    if (extractManifestTargets(data, size, &targets))
+        return targets;
+
+    // Only malformed or unusual manifests get the DOM treatment, and even then
+    // only the resources elements are built, the rest of the manifest is skipped.
+    // QXmlStreamReader didn't like the ASCII encoding used in the package.content files
+    using namespace tinyxml2;
+    static const XMLPath resourcesPath("package/content/resources");
+    if (doc->Parse(data, static_cast<size_t>(size), resourcesPath) == XML_SUCCESS)
+    {
+        XMLElement *e = nullptr;
+        if ((e = doc->FirstChildElement("package")))
+        {
+            if ((e = e->FirstChildElement("content")))
+            {
+                for (e = e->FirstChildElement("resources"); e; e = e->NextSiblingElement("resources"))
+                {
+                    QString attr(e->Attribute("target"));
+                    if (!attr.isEmpty())
+                        targets.append(attr);
+                }
+            }
+        }
+    }
+
+    return targets;
+}
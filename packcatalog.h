@@ -0,0 +1,64 @@
+#ifndef PACKCATALOG_H
+#define PACKCATALOG_H
+
+#include <QSet>
+#include <QHash>
+#include <QString>
+#include <QFileInfo>
+#include <QStringList>
+
+namespace tinyxml2 {
+class XMLDocument;
+}
+
+// Caches the targets found in each package.content so a warm start only
+// has to stat the pack manifests and re-parse the ones that changed.
+class PackCatalog
+{
+public:
+    struct Entry
+    {
+        qint64 size;
+        qint64 modified;
+        QStringList targets;
+    };
+
+    PackCatalog();
+
+    static QString defaultCacheFile();
+
+    bool load(const QString &fileName);
+    bool save(const QString &fileName) const;
+
+    // Entries not looked up or inserted between beginScan() and endScan()
+    // belong to packs that have been removed and are dropped.
+    void beginScan();
+    bool lookup(const QFileInfo &info, QStringList *targets);
+    void insert(const QFileInfo &info, const QStringList &targets);
+    void endScan();
+
+    bool isDirty() const { return m_dirty; }
+
+    // The package.content of the newest installed version of every pack,
+    // ordered by vendor and pack name. Packs dropped into the packs folder as
+    // .atpack archives are returned as the archive itself.
+    static QFileInfoList findManifests(const QString &packsDir);
+
+    // Changes whenever a manifest is added, removed, replaced or modified. Paths
+    // are taken relative to packsDir so moving the whole packs folder is fine.
+    static quint64 fingerprint(const QString &packsDir, const QFileInfoList &manifests);
+
+    // The pack directory of a manifest, or the archive it came from
+    static QString packLocation(const QFileInfo &manifest);
+
+    // Reuses doc, which only holds the last manifest afterwards. bytes, if
+    // set, gets the manifest's size, unpacked for archives.
+    static QStringList parseManifest(const QString &fileName, tinyxml2::XMLDocument *doc, qint64 *bytes = nullptr);
+
+private:
+    QHash<QString, Entry> m_entries;
+    QSet<QString> m_seen;
+    bool m_dirty;
+};
+
+#endif // PACKCATALOG_H
@@ -0,0 +1,237 @@
+#include "packmanifest.h"
+
+#include <cstring>
+
+// Same limit tinyxml2 uses, anything deeper is handed to it to reject
+static const int k_maxDepth = 100;
+
+struct Name
+{
+    const char *data;
+    int size;
+};
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool isNameChar(char c)
+{
+    return !isSpace(c) && c != '/' && c != '>' && c != '=' && c != '<' && c != '"' && c != '\'';
+}
+
+static bool nameEquals(const Name &name, const char *s)
+{
+    int size = static_cast<int>(strlen(s));
+    return name.size == size && memcmp(name.data, s, static_cast<size_t>(size)) == 0;
+}
+
+static bool nameEquals(const Name &a, const Name &b)
+{
+    return a.size == b.size && memcmp(a.data, b.data, static_cast<size_t>(a.size)) == 0;
+}
+
+static const char *skipSpace(const char *p, const char *end)
+{
+    while (p < end && isSpace(*p))
+        ++p;
+    return p;
+}
+
+// Returns the position just past the terminator, or null if it's missing
+static const char *skipPast(const char *p, const char *end, const char *terminator)
+{
+    size_t size = strlen(terminator);
+    while (p + size <= end)
+    {
+        const char *hit = static_cast<const char *>(memchr(p, terminator[0], static_cast<size_t>(end - p)));
+        if (!hit || hit + size > end)
+            return nullptr;
+        if (memcmp(hit, terminator, size) == 0)
+            return hit + size;
+        p = hit + 1;
+    }
+    return nullptr;
+}
+
+bool extractManifestTargets(const char *data, qint64 size, QStringList *targets)
+{
+    const char *p = data;
+    const char *end = data + size;
+
+    // UTF-8 BOM
+    if (size >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+        p += 3;
+
+    static const char *const path[] = { "package", "content", "resources" };
+
+    Name stack[k_maxDepth];
+    int depth = 0;
+    int matched = 0;            // Leading elements of path currently open
+    bool rootSeen = false;
+    bool contentSeen = false;   // Only the first content element counts, like FirstChildElement()
+    QStringList found;
+
+    while (true)
+    {
+        p = static_cast<const char *>(memchr(p, '<', static_cast<size_t>(end - p)));
+        if (!p)
+            break;
+
+        const char *tag = p + 1;
+        if (tag >= end)
+            return false;
+
+        if (*tag == '?')
+        {
+            if (!(p = skipPast(tag, end, "?>")))
+                return false;
+        }
+        else if (end - tag >= 3 && memcmp(tag, "!--", 3) == 0)
+        {
+            if (!(p = skipPast(tag + 3, end, "-->")))
+                return false;
+        }
+        else if (end - tag >= 8 && memcmp(tag, "![CDATA[", 8) == 0)
+        {
+            if (!(p = skipPast(tag + 8, end, "]]>")))
+                return false;
+        }
+        else if (*tag == '!')
+        {
+            // DOCTYPE and friends, internal subsets aren't worth handling here
+            const char *close = static_cast<const char *>(memchr(tag, '>', static_cast<size_t>(end - tag)));
+            if (!close || memchr(tag, '[', static_cast<size_t>(close - tag)))
+                return false;
+            p = close + 1;
+        }
+        else if (*tag == '/')
+        {
+            Name name = { ++tag, 0 };
+            while (tag < end && isNameChar(*tag))
+                ++tag;
+            name.size = static_cast<int>(tag - name.data);
+            tag = skipSpace(tag, end);
+
+            if (depth == 0 || tag >= end || *tag != '>' || !nameEquals(name, stack[depth - 1]))
+                return false;
+
+            --depth;
+            if (matched > depth)
+                matched = depth;
+            p = tag + 1;
+        }
+        else
+        {
+            Name name = { tag, 0 };
+            while (tag < end && isNameChar(*tag))
+                ++tag;
+            name.size = static_cast<int>(tag - name.data);
+            if (name.size == 0)
+                return false;
+
+            if (depth == 0)
+            {
+                // A second root element is malformed
+                if (rootSeen)
+                    return false;
+                rootSeen = true;
+            }
+
+            bool onPath = false;
+            if (depth < 3 && matched == depth && nameEquals(name, path[depth]))
+            {
+                if (depth == 1)
+                {
+                    onPath = !contentSeen;
+                    contentSeen = true;
+                }
+                else
+                {
+                    onPath = true;
+                }
+            }
+
+            bool wantTarget = onPath && depth == 2;
+            bool targetSeen = false;
+            bool selfClosing = false;
+
+            while (true)
+            {
+                const char *attr = skipSpace(tag, end);
+                if (attr >= end)
+                    return false;
+
+                if (*attr == '>')
+                {
+                    tag = attr + 1;
+                    break;
+                }
+                if (*attr == '/')
+                {
+                    if (attr + 1 >= end || attr[1] != '>')
+                        return false;
+                    selfClosing = true;
+                    tag = attr + 2;
+                    break;
+                }
+
+                // Attributes must be separated by whitespace
+                if (attr == tag)
+                    return false;
+
+                Name attrName = { attr, 0 };
+                while (attr < end && isNameChar(*attr))
+                    ++attr;
+                attrName.size = static_cast<int>(attr - attrName.data);
+                if (attrName.size == 0)
+                    return false;
+
+                attr = skipSpace(attr, end);
+                if (attr >= end || *attr != '=')
+                    return false;
+                attr = skipSpace(attr + 1, end);
+                if (attr >= end || (*attr != '"' && *attr != '\''))
+                    return false;
+
+                const char quote = *attr++;
+                const char *close = static_cast<const char *>(memchr(attr, quote, static_cast<size_t>(end - attr)));
+                if (!close || memchr(attr, '<', static_cast<size_t>(close - attr)))
+                    return false;
+
+                if (wantTarget && !targetSeen && nameEquals(attrName, "target"))
+                {
+                    // Leave entity and newline handling to tinyxml2
+                    if (memchr(attr, '&', static_cast<size_t>(close - attr)) ||
+                        memchr(attr, '\r', static_cast<size_t>(close - attr)))
+                    {
+                        return false;
+                    }
+
+                    targetSeen = true;
+                    if (close > attr)
+                        found.append(QString::fromUtf8(attr, static_cast<int>(close - attr)));
+                }
+
+                tag = close + 1;
+            }
+
+            if (!selfClosing)
+            {
+                if (depth == k_maxDepth)
+                    return false;
+                if (onPath && matched == depth)
+                    ++matched;
+                stack[depth++] = name;
+            }
+            p = tag;
+        }
+    }
+
+    if (depth != 0 || !rootSeen)
+        return false;
+
+    targets->append(found);
+    return true;
+}
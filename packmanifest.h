@@ -0,0 +1,13 @@
+#ifndef PACKMANIFEST_H
+#define PACKMANIFEST_H
+
+#include <QStringList>
+
+// Forward-only scanner that pulls the target attribute of every
+// package/content/resources element straight out of a package.content
+// buffer without building a DOM. Returns false on anything it doesn't
+// understand (malformed markup, entities in a target, ...) so the caller
+// can fall back to tinyxml2; targets is left untouched in that case.
+bool extractManifestTargets(const char *data, qint64 size, QStringList *targets);
+
+#endif // PACKMANIFEST_H
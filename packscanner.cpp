@@ -0,0 +1,393 @@
+#include "packscanner.h"
+#include "tinyxml2.h"
+#include "startuptrace.h"
+
+#include <QDir>
+#include <QDebug>
+#include <QTimer>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QThreadStorage>
+#include <QFileSystemWatcher>
+#include <QtConcurrent>
+
+// Flush a batch to the GUI after this many targets or milliseconds,
+// whichever comes first, so the combo box fills steadily without
+// being relaid out for every single device.
+static const int k_batchSize = 256;
+static const int k_batchInterval = 100;
+
+// Manifests handed to the thread pool per core in one go. Small enough
+// that the first targets show up quickly, large enough to keep all cores busy.
+static const int k_filesPerThread = 16;
+
+// atpackmanager touches a lot of files while installing a pack,
+// wait for it to settle before looking at what changed.
+static const int k_refreshDelay = 1000;
+
+// Statistics summed over the manifests parsed since the last report
+struct ParseTotals
+{
+    // Every manifest, whichever parser took it. The time includes reading the file.
+    qint64 manifests;
+    qint64 manifestBytes;
+    qint64 manifestNsecs;
+    // tinyxml2, which only gets the manifests the fast extractor gives up on
+    qint64 documents;
+    qint64 bytes;
+    qint64 nsecs;
+    qint64 nodes;
+    qint64 attributes;
+    // Maximum of any one document, every pool thread keeps its own memory
+    qint64 poolBlocks;
+    qint64 peakBytes;
+};
+
+static QMutex s_totalsMutex;
+static ParseTotals s_totals;
+
+static QStringList parseManifest(const QString &fileName)
+{
+    // One document per pool thread, reused for every manifest it parses
+    static QThreadStorage<tinyxml2::XMLDocument *> documents;
+    if (!documents.hasLocalData())
+    {
+        // Arena mode keeps the buffers between manifests, no allocations per file
+        tinyxml2::XMLDocument *doc = new tinyxml2::XMLDocument;
+        doc->SetArenaMode(true);
+        documents.setLocalData(doc);
+    }
+
+    tinyxml2::XMLDocument *doc = documents.localData();
+    QElapsedTimer timer;
+    timer.start();
+    qint64 bytes = 0;
+    QStringList targets = PackCatalog::parseManifest(fileName, doc, &bytes);
+    const qint64 nsecs = timer.nsecsElapsed();
+
+    QMutexLocker locker(&s_totalsMutex);
+    s_totals.manifests++;
+    s_totals.manifestBytes += bytes;
+    s_totals.manifestNsecs += nsecs;
+
+    // The document is only used for the manifests the fast path gives up on
+    const tinyxml2::XMLStatistics stats = doc->Statistics();
+    if (stats.bytesParsed > 0)
+    {
+        s_totals.documents++;
+        s_totals.bytes += static_cast<qint64>(stats.bytesParsed);
+        s_totals.nsecs += static_cast<qint64>(stats.parseNanoseconds);
+        s_totals.nodes += stats.nodes;
+        s_totals.attributes += stats.attributes;
+        s_totals.poolBlocks = qMax<qint64>(s_totals.poolBlocks, stats.poolBlocks);
+        s_totals.peakBytes = qMax<qint64>(s_totals.peakBytes, static_cast<qint64>(stats.peakBytes));
+        locker.unlock();
+
+        // Resets the statistics for the next manifest, arena mode keeps the memory
+        doc->Clear();
+    }
+
+    return targets;
+}
+
+static void reportParseTotals(bool trace)
+{
+    ParseTotals totals;
+    {
+        QMutexLocker locker(&s_totalsMutex);
+        totals = s_totals;
+        s_totals = ParseTotals();
+    }
+
+    if (totals.manifests == 0)
+        return;
+
+    if (trace)
+    {
+        StartupTrace::count("manifests parsed", totals.manifests);
+        StartupTrace::count("manifest bytes parsed", totals.manifestBytes);
+        StartupTrace::count("manifest parse ns", totals.manifestNsecs);
+        StartupTrace::count("xml fallback documents", totals.documents);
+        StartupTrace::count("xml fallback bytes parsed", totals.bytes);
+        StartupTrace::count("xml fallback parse ns", totals.nsecs);
+        StartupTrace::count("xml fallback nodes", totals.nodes);
+        StartupTrace::count("xml fallback attributes", totals.attributes);
+        StartupTrace::count("xml fallback max pool blocks", totals.poolBlocks);
+        StartupTrace::count("xml fallback max peak bytes", totals.peakBytes);
+    }
+
+    qDebug() << "Parsed" << totals.manifests << "manifests," << totals.manifestBytes << "bytes in"
+             << totals.manifestNsecs / 1000 << "us, reading included";
+    if (totals.documents == 0)
+        return;
+
+    qDebug() << "tinyxml2 parsed" << totals.documents << "of them the fast extractor gave up on," << totals.bytes << "bytes in"
+             << totals.nsecs / 1000 << "us," << totals.nodes << "nodes," << totals.attributes << "attributes,"
+             << "at most" << totals.poolBlocks << "pool blocks and" << totals.peakBytes << "bytes per document";
+}
+
+PackScanner::PackScanner(const QString &packsDir, const QString &cacheFile, QObject *parent) :
+    QObject(parent),
+    m_packsDir(packsDir),
+    m_cacheFile(cacheFile),
+    m_cancelled(0),
+    m_indexFingerprint(0),
+    m_refreshTimer(new QTimer(this)),
+    m_watcher(nullptr)
+{
+    m_refreshTimer->setSingleShot(true);
+    m_refreshTimer->setInterval(k_refreshDelay);
+    connect(m_refreshTimer, &QTimer::timeout, this, &PackScanner::refresh);
+}
+
+void PackScanner::cancel()
+{
+    m_cancelled.storeRelease(1);
+}
+
+QString PackScanner::packDir(const QString &target) const
+{
+    QMutexLocker locker(&m_packDirsMutex);
+    return m_packDirs.value(target);
+}
+
+void PackScanner::setIndex(quint64 fingerprint, const QStringList &targets)
+{
+    m_indexFingerprint = fingerprint;
+    m_indexTargets = targets;
+}
+
+void PackScanner::scan()
+{
+    m_catalog.load(m_cacheFile);
+
+    QStringList targets;
+    if (!collect(true, &targets))
+        return;
+
+    m_targets = QSet<QString>(targets.begin(), targets.end());
+    if (m_catalog.isDirty())
+        m_catalog.save(m_cacheFile);
+
+    emit finished(m_targets.size());
+
+    reportParseTotals(true);
+    StartupTrace::count("targets", m_targets.size());
+    StartupTrace::mark("pack scan");
+    StartupTrace::write();
+
+    watch();
+}
+
+void PackScanner::monitor()
+{
+    // The index's targets are the baseline later changes are reported against
+    m_targets = QSet<QString>(m_indexTargets.begin(), m_indexTargets.end());
+    m_indexTargets.clear();
+
+    // Listing the packs is enough to tell whether the index is current, no manifest is read
+    QFileInfoList files = PackCatalog::findManifests(m_packsDir);
+    if (PackCatalog::fingerprint(m_packsDir, files) == m_indexFingerprint)
+    {
+        m_manifests.clear();
+        foreach (const QFileInfo &info, files)
+            m_manifests.append(info.absoluteFilePath());
+
+        watch();
+        return;
+    }
+
+    // Parses what changed since the index, reports the difference and starts watching
+    m_catalog.load(m_cacheFile);
+    refresh();
+    if (!m_cancelled.loadAcquire())
+        emit indexStale();
+}
+
+void PackScanner::on_packsChanged()
+{
+    m_refreshTimer->start();
+}
+
+void PackScanner::refresh()
+{
+    // Only manifests whose size or mtime changed are parsed again
+    QStringList targets;
+    if (!collect(false, &targets))
+        return;
+
+    QSet<QString> current(targets.begin(), targets.end());
+    QSet<QString> addedSet = current - m_targets;
+    QSet<QString> removedSet = m_targets - current;
+    QStringList added(addedSet.begin(), addedSet.end());
+    QStringList removed(removedSet.begin(), removedSet.end());
+    m_targets = current;
+
+    if (m_catalog.isDirty())
+        m_catalog.save(m_cacheFile);
+
+    if (!added.isEmpty() || !removed.isEmpty())
+        emit targetsChanged(added, removed);
+
+    reportParseTotals(false);
+
+    watch();
+}
+
+bool PackScanner::collect(bool progressive, QStringList *targets)
+{
+    m_catalog.beginScan();
+
+    // Collect everything first so the parsing can be spread over all cores
+    QFileInfoList files = PackCatalog::findManifests(m_packsDir);
+
+    m_manifests.clear();
+    foreach (const QFileInfo &info, files)
+        m_manifests.append(info.absoluteFilePath());
+
+    if (progressive)
+    {
+        StartupTrace::count("manifests", files.size());
+        StartupTrace::mark("pack walk");
+    }
+
+    QStringList batch;
+    QSet<QString> seen;
+    QHash<QString, QString> packDirs;
+    QElapsedTimer timer;
+    timer.start();
+
+    const int chunkSize = qMax(1, QThread::idealThreadCount()) * k_filesPerThread;
+    for (int first = 0; first < files.size(); first += chunkSize)
+    {
+        if (m_cancelled.loadAcquire())
+            return false;
+
+        QFileInfoList chunk = files.mid(first, chunkSize);
+        QVector<QStringList> results(chunk.size());
+
+        QStringList misses;
+        QVector<int> missIndexes;
+        for (int i = 0; i < chunk.size(); ++i)
+        {
+            if (!m_catalog.lookup(chunk.at(i), &results[i]))
+            {
+                misses.append(chunk.at(i).absoluteFilePath());
+                missIndexes.append(i);
+            }
+        }
+
+        if (!misses.isEmpty())
+        {
+            // Results come back in input order, which keeps the merge deterministic
+            QList<QStringList> parsed = QtConcurrent::blockingMapped<QList<QStringList> >(misses, parseManifest);
+            for (int i = 0; i < parsed.size(); ++i)
+            {
+                int index = missIndexes.at(i);
+                results[index] = parsed.at(i);
+                m_catalog.insert(chunk.at(index), parsed.at(i));
+            }
+        }
+
+        QHash<QString, QString> newPackDirs;
+        for (int i = 0; i < results.size(); ++i)
+        {
+            foreach (const QString &target, results.at(i))
+            {
+                if (!seen.contains(target))
+                {
+                    seen.insert(target);
+                    batch.append(target);
+                    newPackDirs.insert(target, PackCatalog::packLocation(chunk.at(i)));
+                }
+            }
+        }
+
+        // Published as we go so devices can be looked up before the scan is done
+        if (!newPackDirs.isEmpty())
+        {
+            QMutexLocker locker(&m_packDirsMutex);
+            for (QHash<QString, QString>::const_iterator it = newPackDirs.constBegin(); it != newPackDirs.constEnd(); ++it)
+            {
+                m_packDirs.insert(it.key(), it.value());
+                packDirs.insert(it.key(), it.value());
+            }
+        }
+
+        if (batch.size() >= k_batchSize || timer.elapsed() >= k_batchInterval)
+        {
+            if (progressive && targets->isEmpty())
+                StartupTrace::mark("first targets");
+            if (progressive)
+                emit targetsFound(batch);
+            targets->append(batch);
+            batch.clear();
+            timer.restart();
+        }
+    }
+
+    if (!batch.isEmpty())
+    {
+        if (progressive && targets->isEmpty())
+            StartupTrace::mark("first targets");
+        if (progressive)
+            emit targetsFound(batch);
+        targets->append(batch);
+    }
+
+    {
+        // Drops the targets of removed packs
+        QMutexLocker locker(&m_packDirsMutex);
+        m_packDirs = packDirs;
+    }
+
+    m_catalog.endScan();
+    return true;
+}
+
+void PackScanner::watch()
+{
+    // Created here so it lives on the scanner thread
+    if (!m_watcher)
+    {
+        m_watcher = new QFileSystemWatcher(this);
+        connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &PackScanner::on_packsChanged);
+        connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &PackScanner::on_packsChanged);
+    }
+
+    // The manifests themselves plus every <vendor>/<pack>/<version> directory,
+    // including ones that have no manifest yet: a pack being installed shows up
+    // one directory at a time, and each one is added here when its parent fires
+    // so the manifest arriving last is seen too. Not the whole tree, the include
+    // and example folders would use up the watch limit for nothing.
+    QString root = QDir(m_packsDir).absolutePath();
+    QSet<QString> paths;
+    paths.insert(root);
+    foreach (const QString &manifest, m_manifests)
+        paths.insert(manifest);
+
+    const QDir::Filters dirs = QDir::Dirs | QDir::NoDotAndDotDot;
+    foreach (const QFileInfo &vendor, QDir(root).entryInfoList(dirs))
+    {
+        paths.insert(vendor.absoluteFilePath());
+        foreach (const QFileInfo &pack, QDir(vendor.absoluteFilePath()).entryInfoList(dirs))
+        {
+            paths.insert(pack.absoluteFilePath());
+            foreach (const QFileInfo &version, QDir(pack.absoluteFilePath()).entryInfoList(dirs))
+                paths.insert(version.absoluteFilePath());
+        }
+    }
+
+    QStringList watchedList = m_watcher->files() + m_watcher->directories();
+    QSet<QString> watched(watchedList.begin(), watchedList.end());
+
+    QSet<QString> staleSet = watched - paths;
+    QStringList stale(staleSet.begin(), staleSet.end());
+    if (!stale.isEmpty())
+        m_watcher->removePaths(stale);
+
+    QSet<QString> missingSet = paths - watched;
+    QStringList missing(missingSet.begin(), missingSet.end());
+    if (!missing.isEmpty())
+        m_watcher->addPaths(missing);
+}
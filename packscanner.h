@@ -0,0 +1,72 @@
+#ifndef PACKSCANNER_H
+#define PACKSCANNER_H
+
+#include "packcatalog.h"
+
+#include <QSet>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QAtomicInt>
+#include <QStringList>
+
+class QTimer;
+class QFileSystemWatcher;
+
+// Walks the packs directory off the GUI thread and reports the targets it
+// finds in batches, so the window can be used while the scan is running.
+// Afterwards it watches the packs so installed, updated or removed packs
+// are picked up without restarting.
+class PackScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    PackScanner(const QString &packsDir, const QString &cacheFile, QObject *parent = nullptr);
+
+    // Safe to call from any thread
+    void cancel();
+
+    // The pack directory, or .atpack archive, that provides target
+    QString packDir(const QString &target) const;
+
+    // What the device index was built from, call before monitor()
+    void setIndex(quint64 fingerprint, const QStringList &targets);
+
+public slots:
+    void scan();
+
+    // For when the targets come from the device index: only lists the packs to
+    // check the index is still current, then watches them like scan() does.
+    // A stale index gets indexStale() and the difference as targetsChanged().
+    void monitor();
+
+signals:
+    void targetsFound(const QStringList &targets);
+    void finished(int count);
+    void targetsChanged(const QStringList &added, const QStringList &removed);
+    void indexStale();
+
+private slots:
+    void on_packsChanged();
+    void refresh();
+
+private:
+    QString m_packsDir;
+    QString m_cacheFile;
+    QAtomicInt m_cancelled;
+    quint64 m_indexFingerprint;
+    QStringList m_indexTargets;
+    PackCatalog m_catalog;
+    QSet<QString> m_targets;
+    QStringList m_manifests;
+    mutable QMutex m_packDirsMutex;
+    QHash<QString, QString> m_packDirs;
+    QTimer *m_refreshTimer;
+    QFileSystemWatcher *m_watcher;
+
+    bool collect(bool progressive, QStringList *targets);
+    void watch();
+};
+
+#endif // PACKSCANNER_H
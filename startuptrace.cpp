@@ -0,0 +1,121 @@
+#include "startuptrace.h"
+
+#include <QHash>
+#include <QFile>
+#include <QMutex>
+#include <QDebug>
+#include <QEvent>
+#include <QVector>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+
+struct Phase
+{
+    QString name;
+    qint64 nsecs;
+};
+
+static QMutex s_mutex;
+static QElapsedTimer s_timer;
+static QString s_fileName;
+static QVector<Phase> s_phases;
+static QHash<QString, qint64> s_counters;
+
+namespace {
+
+class FirstPaintFilter : public QObject
+{
+public:
+    explicit FirstPaintFilter(QObject *parent) : QObject(parent), m_painted(false) {}
+
+    bool eventFilter(QObject *obj, QEvent *event) override
+    {
+        if (event->type() == QEvent::Paint && !m_painted)
+        {
+            m_painted = true;
+            StartupTrace::mark("first paint");
+            StartupTrace::write();
+            deleteLater();
+        }
+        return QObject::eventFilter(obj, event);
+    }
+
+private:
+    bool m_painted;
+};
+
+}
+
+void StartupTrace::start()
+{
+    QMutexLocker locker(&s_mutex);
+    s_timer.start();
+    s_fileName = QString::fromLocal8Bit(qgetenv("ATPROGRAM_GUI_TRACE"));
+}
+
+void StartupTrace::setFile(const QString &fileName)
+{
+    QMutexLocker locker(&s_mutex);
+    s_fileName = fileName;
+}
+
+void StartupTrace::mark(const QString &phase)
+{
+    QMutexLocker locker(&s_mutex);
+    Phase p = { phase, s_timer.nsecsElapsed() };
+    s_phases.append(p);
+}
+
+void StartupTrace::count(const QString &counter, qint64 amount)
+{
+    QMutexLocker locker(&s_mutex);
+    s_counters[counter] += amount;
+}
+
+void StartupTrace::watchFirstPaint()
+{
+    // Application wide so it catches whichever widget paints first,
+    // and removes itself right after
+    qApp->installEventFilter(new FirstPaintFilter(qApp));
+}
+
+void StartupTrace::write()
+{
+    QMutexLocker locker(&s_mutex);
+    if (s_fileName.isEmpty())
+        return;
+
+    QJsonArray phases;
+    qint64 previous = 0;
+    foreach (const Phase &phase, s_phases)
+    {
+        QJsonObject entry;
+        entry.insert("phase", phase.name);
+        entry.insert("ms", phase.nsecs / 1e6);
+        entry.insert("delta_ms", (phase.nsecs - previous) / 1e6);
+        phases.append(entry);
+        previous = phase.nsecs;
+    }
+
+    QJsonObject counters;
+    for (QHash<QString, qint64>::const_iterator it = s_counters.constBegin(); it != s_counters.constEnd(); ++it)
+        counters.insert(it.key(), static_cast<double>(it.value()));
+
+    QJsonObject root;
+    root.insert("version", 1);
+    root.insert("timestamp", QDateTime::currentDateTime().toString(Qt::ISODate));
+    root.insert("phases", phases);
+    root.insert("counters", counters);
+
+    QFile file(s_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(root).toJson());
+}
@@ -0,0 +1,27 @@
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+#include <QString>
+
+// Timestamps the startup phases and counts what the pack scan did. Marks and
+// counters are always recorded (there are only a handful), the JSON file is
+// only written once a file has been set with --trace-startup <file> or the
+// ATPROGRAM_GUI_TRACE environment variable. All functions are thread safe.
+class StartupTrace
+{
+public:
+    // Call first thing in main(), times are relative to it
+    static void start();
+    static void setFile(const QString &fileName);
+
+    static void mark(const QString &phase);
+    static void count(const QString &counter, qint64 amount = 1);
+
+    // Records the "first paint" phase when the first widget gets painted
+    static void watchFirstPaint();
+
+    // Rewrites the whole file, so it can be called after every late phase
+    static void write();
+};
+
+#endif // STARTUPTRACE_H
@@ -0,0 +1,241 @@
+#include "targetindex.h"
+#include "targetmodel.h"
+
+#include <iterator>
+#include <algorithm>
+
+// Match quality tiers. They are further apart than the largest recent use
+// bonus, so a recently used target only wins against matches of the same kind.
+static const int k_exactScore       = 1000;
+static const int k_prefixScore      = 900;
+static const int k_substringScore   = 700;
+static const int k_subsequenceScore = 400;
+static const int k_similarScore     = 100;
+
+static const int k_recentBonus = 4;     // Per place on the recent list
+
+TargetIndex::TargetIndex()
+{
+}
+
+void TargetIndex::build(const QStringList &targets)
+{
+    m_targets = targets;
+    m_keys.clear();
+    m_keys.reserve(targets.size());
+    m_trigrams.clear();
+    m_characters = QVector<QVector<int> >(256);
+
+    for (int id = 0; id < targets.size(); ++id)
+    {
+        QByteArray k = key(targets.at(id));
+        m_keys.append(k);
+
+        // Ids are visited in order, so every posting list stays sorted
+        for (int i = 0; i + 3 <= k.size(); ++i)
+        {
+            QVector<int> &ids = m_trigrams[trigram(k.constData() + i)];
+            if (ids.isEmpty() || ids.last() != id)
+                ids.append(id);
+        }
+
+        foreach (char c, k)
+        {
+            QVector<int> &ids = m_characters[static_cast<uchar>(c)];
+            if (ids.isEmpty() || ids.last() != id)
+                ids.append(id);
+        }
+    }
+
+    for (QHash<quint32, QVector<int> >::iterator it = m_trigrams.begin(); it != m_trigrams.end(); ++it)
+        it.value().squeeze();
+    for (int c = 0; c < m_characters.size(); ++c)
+        m_characters[c].squeeze();
+}
+
+void TargetIndex::setRecent(const QStringList &recent)
+{
+    m_recent.clear();
+    for (int i = 0; i < recent.size() && i < k_maxRecent; ++i)
+        m_recent.insert(recent.at(i), k_maxRecent - i);
+}
+
+QStringList TargetIndex::search(const QString &query, int limit) const
+{
+    QByteArray needle = key(query);
+    if (needle.isEmpty() || m_targets.isEmpty() || limit <= 0)
+        return QStringList();
+
+    // Score per matching target id. Only ids taken from the posting lists
+    // are looked at, so a query doesn't cost anything per indexed target.
+    QHash<int, int> scores;
+
+    QVector<quint32> grams;
+    for (int i = 0; i + 3 <= needle.size(); ++i)
+        grams.append(trigram(needle.constData() + i));
+
+    // A substring or subsequence match has every character of the query
+    QVector<const QVector<int> *> characterLists;
+    bool seen[256] = {};
+    foreach (char c, needle)
+    {
+        const uchar u = static_cast<uchar>(c);
+        if (!seen[u])
+            characterLists.append(&m_characters.at(u));
+        seen[u] = true;
+    }
+
+    // Substring matches. Every trigram of the query has to be in the name,
+    // so only the intersection of their posting lists needs to be checked.
+    QVector<int> candidates;
+    if (grams.isEmpty())
+    {
+        candidates = intersection(characterLists);
+    }
+    else
+    {
+        QVector<const QVector<int> *> lists;
+        foreach (quint32 gram, grams)
+        {
+            QHash<quint32, QVector<int> >::const_iterator it = m_trigrams.constFind(gram);
+            if (it == m_trigrams.constEnd())
+            {
+                lists.clear();
+                break;
+            }
+            lists.append(&it.value());
+        }
+        candidates = intersection(lists);
+    }
+
+    foreach (int id, candidates)
+    {
+        const QByteArray &k = m_keys.at(id);
+        int pos = k.indexOf(needle);
+        if (pos < 0)
+            continue;
+
+        int extra = k.size() - needle.size();
+        if (extra == 0)
+            scores.insert(id, k_exactScore);
+        else if (pos == 0)
+            scores.insert(id, k_prefixScore - qMin(extra, 99));
+        else
+            scores.insert(id, k_substringScore - qMin(pos * 4 + extra, 199));
+    }
+
+    // Not enough direct hits, try the looser matches
+    if (scores.size() < limit)
+    {
+        foreach (int id, intersection(characterLists))
+        {
+            if (scores.contains(id))
+                continue;
+
+            int score = subsequenceScore(needle, m_keys.at(id));
+            if (score > 0)
+                scores.insert(id, score);
+        }
+    }
+
+    // Typos: names sharing at least half of the query trigrams
+    if (scores.size() < limit && grams.size() >= 2)
+    {
+        QHash<int, int> shared;
+        foreach (quint32 gram, grams)
+        {
+            QHash<quint32, QVector<int> >::const_iterator it = m_trigrams.constFind(gram);
+            if (it == m_trigrams.constEnd())
+                continue;
+            foreach (int id, it.value())
+                ++shared[id];
+        }
+
+        for (QHash<int, int>::const_iterator it = shared.constBegin(); it != shared.constEnd(); ++it)
+        {
+            if (scores.contains(it.key()) || it.value() * 2 < grams.size())
+                continue;
+            scores.insert(it.key(), k_similarScore + 99 * it.value() / grams.size());
+        }
+    }
+
+    QVector<QPair<int, int> > ranked;
+    ranked.reserve(scores.size());
+    for (QHash<int, int>::const_iterator it = scores.constBegin(); it != scores.constEnd(); ++it)
+        ranked.append(qMakePair(it.value() + m_recent.value(m_targets.at(it.key())) * k_recentBonus, it.key()));
+
+    // Only the first limit results are shown, the rest needn't be in order
+    QVector<QPair<int, int> >::iterator end = ranked.begin() + qMin(limit, ranked.size());
+    std::partial_sort(ranked.begin(), end, ranked.end(), [this](const QPair<int, int> &a, const QPair<int, int> &b) {
+        if (a.first != b.first)
+            return a.first > b.first;
+        return TargetModel::lessThan(m_targets.at(a.second), m_targets.at(b.second));
+    });
+
+    QStringList results;
+    for (QVector<QPair<int, int> >::const_iterator it = ranked.constBegin(); it != end; ++it)
+        results.append(m_targets.at(it->second));
+
+    return results;
+}
+
+QByteArray TargetIndex::key(const QString &text)
+{
+    QByteArray result;
+    result.reserve(text.size());
+    foreach (QChar c, text)
+    {
+        char latin = c.toLower().toLatin1();
+        if (latin && c.isLetterOrNumber())
+            result.append(latin);
+    }
+    return result;
+}
+
+quint32 TargetIndex::trigram(const char *p)
+{
+    return (static_cast<quint32>(static_cast<uchar>(p[0])) << 16) |
+           (static_cast<quint32>(static_cast<uchar>(p[1])) << 8) |
+            static_cast<quint32>(static_cast<uchar>(p[2]));
+}
+
+QVector<int> TargetIndex::intersection(QVector<const QVector<int> *> lists)
+{
+    // Ids in all the sorted lists, smallest list first so the result shrinks fast
+    if (lists.isEmpty())
+        return QVector<int>();
+
+    std::sort(lists.begin(), lists.end(), [](const QVector<int> *a, const QVector<int> *b) {
+        return a->size() < b->size();
+    });
+
+    QVector<int> result = *lists.first();
+    for (int i = 1; i < lists.size() && !result.isEmpty(); ++i)
+    {
+        QVector<int> merged;
+        std::set_intersection(result.constBegin(), result.constEnd(),
+                              lists.at(i)->constBegin(), lists.at(i)->constEnd(),
+                              std::back_inserter(merged));
+        result = merged;
+    }
+    return result;
+}
+
+int TargetIndex::subsequenceScore(const QByteArray &needle, const QByteArray &haystack)
+{
+    // Every query character in order, fewer and shorter gaps rank higher
+    int gaps = 0;
+    int last = -1;
+    int pos = 0;
+    foreach (char c, needle)
+    {
+        pos = haystack.indexOf(c, pos);
+        if (pos < 0)
+            return 0;
+        if (last >= 0 && pos != last + 1)
+            gaps += pos - last;
+        last = pos++;
+    }
+
+    return k_subsequenceScore - qMin(gaps * 8, 199);
+}
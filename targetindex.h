@@ -0,0 +1,40 @@
+#ifndef TARGETINDEX_H
+#define TARGETINDEX_H
+
+#include <QHash>
+#include <QVector>
+#include <QByteArray>
+#include <QStringList>
+
+// Search index over the target names for the target selector. Names are
+// matched on a lower cased, alphanumeric only key through a trigram index,
+// so "128db48" finds AVR128DB48 and "tiny1616" finds ATtiny1616. Queries that
+// aren't a substring of any name fall back to subsequence and trigram
+// similarity matching. Results are ranked by match quality, then recent use.
+class TargetIndex
+{
+public:
+    // Length of the recent list that still earns a ranking bonus
+    static const int k_maxRecent = 20;
+
+    TargetIndex();
+
+    void build(const QStringList &targets);
+    void setRecent(const QStringList &recent);
+
+    QStringList search(const QString &query, int limit) const;
+
+private:
+    QStringList m_targets;
+    QVector<QByteArray> m_keys;
+    QHash<quint32, QVector<int> > m_trigrams;
+    QVector<QVector<int> > m_characters;
+    QHash<QString, int> m_recent;
+
+    static QByteArray key(const QString &text);
+    static quint32 trigram(const char *p);
+    static QVector<int> intersection(QVector<const QVector<int> *> lists);
+    static int subsequenceScore(const QByteArray &needle, const QByteArray &haystack);
+};
+
+#endif // TARGETINDEX_H
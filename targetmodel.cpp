@@ -0,0 +1,111 @@
+#include "targetmodel.h"
+
+#include <algorithm>
+
+TargetModel::TargetModel(QObject *parent) :
+    QAbstractListModel(parent)
+{
+}
+
+int TargetModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_targets.size();
+}
+
+QVariant TargetModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_targets.size())
+        return QVariant();
+
+    if (role == Qt::DisplayRole || role == Qt::EditRole)
+        return m_targets.at(index.row());
+
+    return QVariant();
+}
+
+bool TargetModel::contains(const QString &target) const
+{
+    QStringList::const_iterator it = std::lower_bound(m_targets.constBegin(), m_targets.constEnd(), target, lessThan);
+    return it != m_targets.constEnd() && *it == target;
+}
+
+void TargetModel::setTargets(const QStringList &targets)
+{
+    beginResetModel();
+    m_targets = sorted(targets);
+    endResetModel();
+}
+
+void TargetModel::addTargets(const QStringList &targets)
+{
+    if (targets.isEmpty())
+        return;
+
+    if (m_targets.isEmpty())
+    {
+        setTargets(targets);
+        return;
+    }
+
+    QStringList added = sorted(targets);
+
+    // Both lists are sorted, so each run of new targets that lands between the
+    // same two existing rows goes in with a single insert
+    int row = 0;
+    int i = 0;
+    while (i < added.size())
+    {
+        const QString &target = added.at(i);
+        row = static_cast<int>(std::lower_bound(m_targets.constBegin() + row, m_targets.constEnd(), target, lessThan)
+                               - m_targets.constBegin());
+        if (row < m_targets.size() && m_targets.at(row) == target)
+        {
+            ++i;
+            continue;
+        }
+
+        int last = i + 1;
+        while (last < added.size() &&
+               (row == m_targets.size() || lessThan(added.at(last), m_targets.at(row))))
+        {
+            ++last;
+        }
+
+        beginInsertRows(QModelIndex(), row, row + last - i - 1);
+        for (int j = i; j < last; ++j)
+            m_targets.insert(row + j - i, added.at(j));
+        endInsertRows();
+
+        row += last - i;
+        i = last;
+    }
+}
+
+void TargetModel::removeTargets(const QStringList &targets)
+{
+    foreach (const QString &target, targets)
+    {
+        QStringList::const_iterator it = std::lower_bound(m_targets.constBegin(), m_targets.constEnd(), target, lessThan);
+        if (it == m_targets.constEnd() || *it != target)
+            continue;
+
+        int row = static_cast<int>(it - m_targets.constBegin());
+        beginRemoveRows(QModelIndex(), row, row);
+        m_targets.removeAt(row);
+        endRemoveRows();
+    }
+}
+
+bool TargetModel::lessThan(const QString &a, const QString &b)
+{
+    int result = QString::compare(a, b, Qt::CaseInsensitive);
+    return result < 0 || (result == 0 && a < b);
+}
+
+QStringList TargetModel::sorted(const QStringList &targets)
+{
+    QStringList result = targets;
+    std::sort(result.begin(), result.end(), lessThan);
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
@@ -0,0 +1,34 @@
+#ifndef TARGETMODEL_H
+#define TARGETMODEL_H
+
+#include <QStringList>
+#include <QAbstractListModel>
+
+// Sorted, duplicate free list of target names behind the target combo box,
+// which the target search index is built from.
+class TargetModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit TargetModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    const QStringList &targets() const { return m_targets; }
+    bool contains(const QString &target) const;
+
+    void setTargets(const QStringList &targets);
+    void addTargets(const QStringList &targets);
+    void removeTargets(const QStringList &targets);
+
+    static bool lessThan(const QString &a, const QString &b);
+
+private:
+    QStringList m_targets;
+
+    static QStringList sorted(const QStringList &targets);
+};
+
+#endif // TARGETMODEL_H
@@ -32,6 +32,47 @@ distribution.
 #   include <cstdarg>
 #endif
 
+#if defined(_WIN32)
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <windows.h>
+#   define TIXML_MMAP
+#elif defined(__unix__) || defined(__APPLE__)
+#   include <fcntl.h>
+#   include <time.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   define TIXML_MMAP
+#else
+#   include <time.h>
+#endif
+
+// Vectorized scanning for the delimiter searches, see XMLUtil::FindChar().
+// Define TINYXML2_NO_SIMD to build with the scalar loops only.
+#if !defined(TINYXML2_NO_SIMD)
+#   if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#       include <immintrin.h>
+#       define TIXML_SIMD
+#       define TIXML_TARGET_SSE2 __attribute__((target("sse2")))
+#       define TIXML_TARGET_AVX2 __attribute__((target("avx2")))
+        // Aligned vector loads can read past the terminating null, never past
+        // the page it is on. That is safe, but the address sanitizer can't tell.
+#       define TIXML_NO_SANITIZE __attribute__((no_sanitize_address))
+#   elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#       include <intrin.h>
+#       include <immintrin.h>
+#       define TIXML_SIMD
+#       define TIXML_TARGET_SSE2
+#       define TIXML_TARGET_AVX2
+#       define TIXML_NO_SANITIZE
+#   endif
+#endif
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1400 ) && (!defined WINCE)
 	// Microsoft Visual Studio, version 2005 and higher. Not WinCE.
 	/*int _snprintf_s(
@@ -200,18 +241,22 @@ char* StrPair::ParseText( char* p, const char* endTag, int strFlags, int* curLin
     char  endChar = *endTag;
     size_t length = strlen( endTag );
 
-    // Inner loop of text parsing.
-    while ( *p ) {
-        if ( *p == endChar && strncmp( p, endTag, length ) == 0 ) {
+    // Inner loop of text parsing. FindChar() jumps to the next candidate
+    // and counts the lines on the way.
+    for( ;; ) {
+        p = const_cast<char*>( XMLUtil::FindChar( p, endChar, curLineNumPtr ) );
+        if ( !*p ) {
+            return 0;
+        }
+        if ( strncmp( p, endTag, length ) == 0 ) {
             Set( start, p, strFlags );
             return p + length;
-        } else if (*p == '\n') {
+        }
+        if ( *p == '\n' ) {
             ++(*curLineNumPtr);
         }
         ++p;
-        TIXMLASSERT( p );
     }
-    return 0;
 }
 
 
@@ -225,10 +270,7 @@ char* StrPair::ParseName( char* p )
     }
 
     char* const start = p;
-    ++p;
-    while ( *p && XMLUtil::IsNameChar( *p ) ) {
-        ++p;
-    }
+    p = const_cast<char*>( XMLUtil::SkipNameChars( p + 1 ) );
 
     Set( start, p, 0 );
     return p;
@@ -382,6 +424,373 @@ void XMLUtil::SetBoolSerialization(const char* writeTrue, const char* writeFalse
 }
 
 
+/*
+	Scanning primitives behind SkipWhiteSpace(), ParseText() and ParseName().
+	Each has a scalar version and, on x86, SSE2 and AVX2 versions that test 16
+	or 32 bytes at a time. The vector loads are aligned so they never cross
+	into a page the string doesn't reach; bytes before the start are masked
+	off. The best version the CPU supports is picked on first use.
+*/
+
+static const char* SkipWhiteSpaceScalar( const char* p, int* curLineNumPtr )
+{
+    while ( XMLUtil::IsWhiteSpace( *p ) ) {
+        if ( curLineNumPtr && *p == '\n' ) {
+            ++(*curLineNumPtr);
+        }
+        ++p;
+    }
+    return p;
+}
+
+static const char* FindCharScalar( const char* p, char c, int* curLineNumPtr )
+{
+    while ( *p && *p != c ) {
+        if ( curLineNumPtr && *p == '\n' ) {
+            ++(*curLineNumPtr);
+        }
+        ++p;
+    }
+    return p;
+}
+
+static const char* SkipNameCharsScalar( const char* p )
+{
+    while ( *p && XMLUtil::IsNameChar( *p ) ) {
+        ++p;
+    }
+    return p;
+}
+
+#if defined(TIXML_SIMD)
+
+static inline int CountBits( unsigned int bits )
+{
+    // No popcnt instruction, it isn't implied by SSE2
+    bits = bits - ( ( bits >> 1 ) & 0x55555555u );
+    bits = ( bits & 0x33333333u ) + ( ( bits >> 2 ) & 0x33333333u );
+    bits = ( bits + ( bits >> 4 ) ) & 0x0f0f0f0fu;
+    return static_cast<int>( ( bits * 0x01010101u ) >> 24 );
+}
+
+static inline int LowestBit( unsigned int bits )
+{
+    TIXMLASSERT( bits );
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward( &index, bits );
+    return static_cast<int>( index );
+#else
+    return __builtin_ctz( bits );
+#endif
+}
+
+// Where a block scan ends: counts the newlines before the stop byte
+static inline const char* StopAt( const char* block, unsigned int stop, unsigned int newlines, int* curLineNumPtr )
+{
+    const int index = LowestBit( stop );
+    if ( curLineNumPtr ) {
+        *curLineNumPtr += CountBits( newlines & ( ( 1u << index ) - 1 ) );
+    }
+    return block + index;
+}
+
+// The byte classes use signed compares: bytes of 0x80 and up are negative,
+// which keeps them out of every ASCII range.
+
+TIXML_TARGET_SSE2 static inline __m128i InRange128( __m128i x, char low, char high )
+{
+    return _mm_and_si128( _mm_cmpgt_epi8( x, _mm_set1_epi8( static_cast<char>( low - 1 ) ) ),
+                          _mm_cmpgt_epi8( _mm_set1_epi8( static_cast<char>( high + 1 ) ), x ) );
+}
+
+TIXML_TARGET_SSE2 static inline __m128i IsWhiteSpace128( __m128i x )
+{
+    // isspace() for ASCII: space, \t \n \v \f \r
+    return _mm_or_si128( _mm_cmpeq_epi8( x, _mm_set1_epi8( ' ' ) ), InRange128( x, '\t', '\r' ) );
+}
+
+TIXML_TARGET_SSE2 static inline __m128i IsNameChar128( __m128i x )
+{
+    __m128i name = _mm_cmpgt_epi8( _mm_setzero_si128(), x );
+    name = _mm_or_si128( name, InRange128( _mm_or_si128( x, _mm_set1_epi8( 0x20 ) ), 'a', 'z' ) );
+    name = _mm_or_si128( name, InRange128( x, '0', '9' ) );
+    name = _mm_or_si128( name, InRange128( x, '-', '.' ) );
+    name = _mm_or_si128( name, _mm_cmpeq_epi8( x, _mm_set1_epi8( ':' ) ) );
+    return _mm_or_si128( name, _mm_cmpeq_epi8( x, _mm_set1_epi8( '_' ) ) );
+}
+
+TIXML_NO_SANITIZE TIXML_TARGET_SSE2 static const char* SkipWhiteSpaceSSE2( const char* p, int* curLineNumPtr )
+{
+    const size_t offset = reinterpret_cast<size_t>( p ) & 15;
+    const char* block = p - offset;
+    unsigned int valid = ( 0xffffu << offset ) & 0xffffu;
+    const __m128i newline = _mm_set1_epi8( '\n' );
+
+    for( ;; ) {
+        const __m128i x = _mm_load_si128( reinterpret_cast<const __m128i*>( block ) );
+        const unsigned int stop = ~static_cast<unsigned int>( _mm_movemask_epi8( IsWhiteSpace128( x ) ) ) & valid;
+        const unsigned int newlines = static_cast<unsigned int>( _mm_movemask_epi8( _mm_cmpeq_epi8( x, newline ) ) ) & valid;
+        if ( stop ) {
+            return StopAt( block, stop, newlines, curLineNumPtr );
+        }
+        if ( curLineNumPtr ) {
+            *curLineNumPtr += CountBits( newlines );
+        }
+        block += 16;
+        valid = 0xffffu;
+    }
+}
+
+TIXML_NO_SANITIZE TIXML_TARGET_SSE2 static const char* FindCharSSE2( const char* p, char c, int* curLineNumPtr )
+{
+    const size_t offset = reinterpret_cast<size_t>( p ) & 15;
+    const char* block = p - offset;
+    unsigned int valid = ( 0xffffu << offset ) & 0xffffu;
+    const __m128i target = _mm_set1_epi8( c );
+    const __m128i newline = _mm_set1_epi8( '\n' );
+    const __m128i zero = _mm_setzero_si128();
+
+    for( ;; ) {
+        const __m128i x = _mm_load_si128( reinterpret_cast<const __m128i*>( block ) );
+        const __m128i hit = _mm_or_si128( _mm_cmpeq_epi8( x, target ), _mm_cmpeq_epi8( x, zero ) );
+        const unsigned int stop = static_cast<unsigned int>( _mm_movemask_epi8( hit ) ) & valid;
+        const unsigned int newlines = static_cast<unsigned int>( _mm_movemask_epi8( _mm_cmpeq_epi8( x, newline ) ) ) & valid;
+        if ( stop ) {
+            return StopAt( block, stop, newlines, curLineNumPtr );
+        }
+        if ( curLineNumPtr ) {
+            *curLineNumPtr += CountBits( newlines );
+        }
+        block += 16;
+        valid = 0xffffu;
+    }
+}
+
+TIXML_NO_SANITIZE TIXML_TARGET_SSE2 static const char* SkipNameCharsSSE2( const char* p )
+{
+    const size_t offset = reinterpret_cast<size_t>( p ) & 15;
+    const char* block = p - offset;
+    unsigned int valid = ( 0xffffu << offset ) & 0xffffu;
+
+    for( ;; ) {
+        const __m128i x = _mm_load_si128( reinterpret_cast<const __m128i*>( block ) );
+        const unsigned int stop = ~static_cast<unsigned int>( _mm_movemask_epi8( IsNameChar128( x ) ) ) & valid;
+        if ( stop ) {
+            return block + LowestBit( stop );
+        }
+        block += 16;
+        valid = 0xffffu;
+    }
+}
+
+TIXML_TARGET_AVX2 static inline __m256i InRange256( __m256i x, char low, char high )
+{
+    return _mm256_and_si256( _mm256_cmpgt_epi8( x, _mm256_set1_epi8( static_cast<char>( low - 1 ) ) ),
+                             _mm256_cmpgt_epi8( _mm256_set1_epi8( static_cast<char>( high + 1 ) ), x ) );
+}
+
+TIXML_TARGET_AVX2 static inline __m256i IsWhiteSpace256( __m256i x )
+{
+    return _mm256_or_si256( _mm256_cmpeq_epi8( x, _mm256_set1_epi8( ' ' ) ), InRange256( x, '\t', '\r' ) );
+}
+
+TIXML_TARGET_AVX2 static inline __m256i IsNameChar256( __m256i x )
+{
+    __m256i name = _mm256_cmpgt_epi8( _mm256_setzero_si256(), x );
+    name = _mm256_or_si256( name, InRange256( _mm256_or_si256( x, _mm256_set1_epi8( 0x20 ) ), 'a', 'z' ) );
+    name = _mm256_or_si256( name, InRange256( x, '0', '9' ) );
+    name = _mm256_or_si256( name, InRange256( x, '-', '.' ) );
+    name = _mm256_or_si256( name, _mm256_cmpeq_epi8( x, _mm256_set1_epi8( ':' ) ) );
+    return _mm256_or_si256( name, _mm256_cmpeq_epi8( x, _mm256_set1_epi8( '_' ) ) );
+}
+
+TIXML_NO_SANITIZE TIXML_TARGET_AVX2 static const char* SkipWhiteSpaceAVX2( const char* p, int* curLineNumPtr )
+{
+    const size_t offset = reinterpret_cast<size_t>( p ) & 31;
+    const char* block = p - offset;
+    unsigned int valid = 0xffffffffu << offset;
+    const __m256i newline = _mm256_set1_epi8( '\n' );
+
+    for( ;; ) {
+        const __m256i x = _mm256_load_si256( reinterpret_cast<const __m256i*>( block ) );
+        const unsigned int stop = ~static_cast<unsigned int>( _mm256_movemask_epi8( IsWhiteSpace256( x ) ) ) & valid;
+        const unsigned int newlines = static_cast<unsigned int>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( x, newline ) ) ) & valid;
+        if ( stop ) {
+            return StopAt( block, stop, newlines, curLineNumPtr );
+        }
+        if ( curLineNumPtr ) {
+            *curLineNumPtr += CountBits( newlines );
+        }
+        block += 32;
+        valid = 0xffffffffu;
+    }
+}
+
+TIXML_NO_SANITIZE TIXML_TARGET_AVX2 static const char* FindCharAVX2( const char* p, char c, int* curLineNumPtr )
+{
+    const size_t offset = reinterpret_cast<size_t>( p ) & 31;
+    const char* block = p - offset;
+    unsigned int valid = 0xffffffffu << offset;
+    const __m256i target = _mm256_set1_epi8( c );
+    const __m256i newline = _mm256_set1_epi8( '\n' );
+    const __m256i zero = _mm256_setzero_si256();
+
+    for( ;; ) {
+        const __m256i x = _mm256_load_si256( reinterpret_cast<const __m256i*>( block ) );
+        const __m256i hit = _mm256_or_si256( _mm256_cmpeq_epi8( x, target ), _mm256_cmpeq_epi8( x, zero ) );
+        const unsigned int stop = static_cast<unsigned int>( _mm256_movemask_epi8( hit ) ) & valid;
+        const unsigned int newlines = static_cast<unsigned int>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( x, newline ) ) ) & valid;
+        if ( stop ) {
+            return StopAt( block, stop, newlines, curLineNumPtr );
+        }
+        if ( curLineNumPtr ) {
+            *curLineNumPtr += CountBits( newlines );
+        }
+        block += 32;
+        valid = 0xffffffffu;
+    }
+}
+
+TIXML_NO_SANITIZE TIXML_TARGET_AVX2 static const char* SkipNameCharsAVX2( const char* p )
+{
+    const size_t offset = reinterpret_cast<size_t>( p ) & 31;
+    const char* block = p - offset;
+    unsigned int valid = 0xffffffffu << offset;
+
+    for( ;; ) {
+        const __m256i x = _mm256_load_si256( reinterpret_cast<const __m256i*>( block ) );
+        const unsigned int stop = ~static_cast<unsigned int>( _mm256_movemask_epi8( IsNameChar256( x ) ) ) & valid;
+        if ( stop ) {
+            return block + LowestBit( stop );
+        }
+        block += 32;
+        valid = 0xffffffffu;
+    }
+}
+
+enum ScanLevel { SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2 };
+
+static ScanLevel DetectScanLevel()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid( info, 0 );
+    const int maxLeaf = info[0];
+    __cpuid( info, 1 );
+    const bool sse2 = ( info[3] & ( 1 << 26 ) ) != 0;
+    // AVX2 also needs the OS to save the ymm registers (OSXSAVE and XCR0)
+    const bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+    bool avx2 = false;
+    if ( maxLeaf >= 7 && osxsave && ( _xgetbv( 0 ) & 6 ) == 6 ) {
+        __cpuidex( info, 7, 0 );
+        avx2 = ( info[1] & ( 1 << 5 ) ) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    const bool sse2 = __builtin_cpu_supports( "sse2" ) != 0;
+    const bool avx2 = __builtin_cpu_supports( "avx2" ) != 0;
+#endif
+    return avx2 ? SCAN_AVX2 : sse2 ? SCAN_SSE2 : SCAN_SCALAR;
+}
+
+static bool vectorScanning = true;
+
+static ScanLevel CurrentScanLevel()
+{
+    static const ScanLevel level = DetectScanLevel();
+    return vectorScanning ? level : SCAN_SCALAR;
+}
+
+#endif // TIXML_SIMD
+
+
+void XMLUtil::SetVectorScanning( bool enable )
+{
+#if defined(TIXML_SIMD)
+    vectorScanning = enable;
+#else
+    (void)enable;
+#endif
+}
+
+
+bool XMLUtil::VectorScanning()
+{
+#if defined(TIXML_SIMD)
+    return CurrentScanLevel() != SCAN_SCALAR;
+#else
+    return false;
+#endif
+}
+
+
+size_t XMLUtil::PageSize()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    return info.dwPageSize;
+#elif defined(TIXML_MMAP)
+    const long pageSize = sysconf( _SC_PAGESIZE );
+    return pageSize > 0 ? static_cast<size_t>( pageSize ) : 0;
+#else
+    return 0;
+#endif
+}
+
+
+const char* XMLUtil::SkipWhiteSpaceRun( const char* p, int* curLineNumPtr )
+{
+    TIXMLASSERT( p );
+#if defined(TIXML_SIMD)
+    switch ( CurrentScanLevel() ) {
+        case SCAN_AVX2:
+            return SkipWhiteSpaceAVX2( p, curLineNumPtr );
+        case SCAN_SSE2:
+            return SkipWhiteSpaceSSE2( p, curLineNumPtr );
+        default:
+            break;
+    }
+#endif
+    return SkipWhiteSpaceScalar( p, curLineNumPtr );
+}
+
+
+const char* XMLUtil::FindChar( const char* p, char c, int* curLineNumPtr )
+{
+    TIXMLASSERT( p );
+#if defined(TIXML_SIMD)
+    switch ( CurrentScanLevel() ) {
+        case SCAN_AVX2:
+            return FindCharAVX2( p, c, curLineNumPtr );
+        case SCAN_SSE2:
+            return FindCharSSE2( p, c, curLineNumPtr );
+        default:
+            break;
+    }
+#endif
+    return FindCharScalar( p, c, curLineNumPtr );
+}
+
+
+const char* XMLUtil::SkipNameChars( const char* p )
+{
+    TIXMLASSERT( p );
+#if defined(TIXML_SIMD)
+    switch ( CurrentScanLevel() ) {
+        case SCAN_AVX2:
+            return SkipNameCharsAVX2( p );
+        case SCAN_SSE2:
+            return SkipNameCharsSSE2( p );
+        default:
+            break;
+    }
+#endif
+    return SkipNameCharsScalar( p );
+}
+
+
 const char* XMLUtil::ReadBOM( const char* p, bool* bom )
 {
     TIXMLASSERT( p );
@@ -770,7 +1179,10 @@ const char* XMLNode::Value() const
 
 void XMLNode::SetValue( const char* str, bool staticMem )
 {
-    if ( staticMem ) {
+    if ( _document && _document->_nameTable && ToElement() ) {
+        _value.SetInternedStr( _document->_nameTable->Intern( str ) );
+    }
+    else if ( staticMem ) {
         _value.SetInternedStr( str );
     }
     else {
@@ -939,6 +1351,9 @@ XMLNode* XMLNode::InsertAfterChild( XMLNode* afterThis, XMLNode* addThis )
 
 const XMLElement* XMLNode::FirstChildElement( const char* name ) const
 {
+    if ( !LookupName( &name ) ) {
+        return 0;
+    }
     for( const XMLNode* node = _firstChild; node; node = node->_next ) {
         const XMLElement* element = node->ToElementWithName( name );
         if ( element ) {
@@ -951,6 +1366,9 @@ const XMLElement* XMLNode::FirstChildElement( const char* name ) const
 
 const XMLElement* XMLNode::LastChildElement( const char* name ) const
 {
+    if ( !LookupName( &name ) ) {
+        return 0;
+    }
     for( const XMLNode* node = _lastChild; node; node = node->_prev ) {
         const XMLElement* element = node->ToElementWithName( name );
         if ( element ) {
@@ -963,6 +1381,9 @@ const XMLElement* XMLNode::LastChildElement( const char* name ) const
 
 const XMLElement* XMLNode::NextSiblingElement( const char* name ) const
 {
+    if ( !LookupName( &name ) ) {
+        return 0;
+    }
     for( const XMLNode* node = _next; node; node = node->_next ) {
         const XMLElement* element = node->ToElementWithName( name );
         if ( element ) {
@@ -975,6 +1396,9 @@ const XMLElement* XMLNode::NextSiblingElement( const char* name ) const
 
 const XMLElement* XMLNode::PreviousSiblingElement( const char* name ) const
 {
+    if ( !LookupName( &name ) ) {
+        return 0;
+    }
     for( const XMLNode* node = _prev; node; node = node->_prev ) {
         const XMLElement* element = node->ToElementWithName( name );
         if ( element ) {
@@ -1011,6 +1435,19 @@ char* XMLNode::ParseDeep( char* p, StrPair* parentEndTag, int* curLineNumPtr )
 	while( p && *p ) {
         XMLNode* node = 0;
 
+        if ( _document->_parsePath ) {
+            // Partial parse: jump to the next element on the path
+            const int skipLineNum = *curLineNumPtr;
+            p = _document->SkipUnmatched( p, curLineNumPtr );
+            if ( !p ) {
+                _document->SetError( XML_ERROR_PARSING, skipLineNum, 0 );
+                break;
+            }
+            if ( !*p ) {
+                break;
+            }
+        }
+
         p = _document->Identify( p, &node );
         TIXMLASSERT( p );
         if ( node == 0 ) {
@@ -1137,12 +1574,30 @@ const XMLElement* XMLNode::ToElementWithName( const char* name ) const
     if ( name == 0 ) {
         return element;
     }
+    if ( _document->_nameTable ) {
+        // Both sides are interned, see LookupName()
+        return element->Name() == name ? element : 0;
+    }
     if ( XMLUtil::StringEqual( element->Name(), name ) ) {
        return element;
     }
     return 0;
 }
 
+
+// With a name table, replaces *name by the table's copy. Returns false
+// if it isn't in the table, then no element can have that name.
+bool XMLNode::LookupName( const char** name ) const
+{
+    if ( *name == 0 || _document->_nameTable == 0 ) {
+        return true;
+    }
+    if ( !_document->_nameTable->Owns( *name ) ) {
+        *name = _document->_nameTable->Find( *name );
+    }
+    return *name != 0;
+}
+
 // --------- XMLText ---------- //
 char* XMLText::ParseDeep( char* p, StrPair*, int* curLineNumPtr )
 {
@@ -1514,6 +1969,17 @@ XMLElement::~XMLElement()
 
 const XMLAttribute* XMLElement::FindAttribute( const char* name ) const
 {
+    if ( _document->_nameTable ) {
+        if ( !_document->_nameTable->Owns( name ) ) {
+            name = _document->_nameTable->Find( name );
+        }
+        for( XMLAttribute* a = _rootAttribute; name && a; a = a->_next ) {
+            if ( a->Name() == name ) {
+                return a;
+            }
+        }
+        return 0;
+    }
     for( XMLAttribute* a = _rootAttribute; a; a = a->_next ) {
         if ( XMLUtil::StringEqual( a->Name(), name ) ) {
             return a;
@@ -1787,7 +2253,12 @@ XMLAttribute* XMLElement::FindOrCreateAttribute( const char* name )
             TIXMLASSERT( _rootAttribute == 0 );
             _rootAttribute = attrib;
         }
-        attrib->SetName( name );
+        if ( _document->_nameTable ) {
+            attrib->_name.SetInternedStr( _document->_nameTable->Intern( name ) );
+        }
+        else {
+            attrib->SetName( name );
+        }
     }
     return attrib;
 }
@@ -1833,6 +2304,9 @@ char* XMLElement::ParseAttributes( char* p, int* curLineNumPtr )
             int attrLineNum = attrib->_parseLineNum;
 
             p = attrib->ParseDeep( p, _document->ProcessEntities(), curLineNumPtr );
+            if ( p && _document->_nameTable ) {
+                attrib->_name.SetInternedStr( _document->_nameTable->Intern( attrib->Name() ) );
+            }
             if ( !p || Attribute( attrib->Name() ) ) {
                 DeleteAttribute( attrib );
                 _document->SetError( XML_ERROR_PARSING_ATTRIBUTE, attrLineNum, "XMLElement name=%s", Name() );
@@ -1914,6 +2388,10 @@ char* XMLElement::ParseDeep( char* p, StrPair* parentEndTag, int* curLineNumPtr
     }
 
     p = ParseAttributes( p, curLineNumPtr );
+    if ( p && _closingType != CLOSING && _document->_nameTable ) {
+        // Past the start tag, so terminating the name in place is safe
+        _value.SetInternedStr( _document->_nameTable->Intern( Name() ) );
+    }
     if ( !p || !*p || _closingType != OPEN ) {
         return p;
     }
@@ -2003,48 +2481,317 @@ const char* XMLDocument::_errorNames[XML_ERROR_COUNT] = {
 };
 
 
-XMLDocument::XMLDocument( bool processEntities, Whitespace whitespaceMode ) :
-    XMLNode( 0 ),
-    _writeBOM( false ),
-    _processEntities( processEntities ),
-    _errorID(XML_SUCCESS),
-    _whitespaceMode( whitespaceMode ),
-    _errorStr(),
-    _errorLineNum( 0 ),
-    _charBuffer( 0 ),
-    _parseCurLineNum( 0 ),
-	_parsingDepth(0),
-    _unlinked(),
-    _elementPool(),
-    _attributePool(),
-    _textPool(),
-    _commentPool()
+// Maps a file copy-on-write, so the parser can terminate strings in place
+// without touching the file. Returns 0 when the file can't be mapped, or
+// when it ends exactly on a page boundary: the parser needs a terminating
+// null, which otherwise comes for free from the zero filled tail of the last page.
+static char* MapFile( const char* filepath, size_t* size )
 {
-    // avoid VC++ C4355 warning about 'this' in initializer list (C4355 is off by default in VS2012+)
-    _document = this;
-}
+#if defined(_WIN32)
+    HANDLE file = CreateFileA( filepath, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+    if ( file == INVALID_HANDLE_VALUE ) {
+        return 0;
+    }
 
+    LARGE_INTEGER length;
+    if ( !GetFileSizeEx( file, &length ) || length.QuadPart <= 0 ||
+         static_cast<unsigned long long>( length.QuadPart ) >= (size_t)-1 ||
+         static_cast<size_t>( length.QuadPart ) % XMLUtil::PageSize() == 0 ) {
+        CloseHandle( file );
+        return 0;
+    }
 
-XMLDocument::~XMLDocument()
-{
-    Clear();
-}
+    // The view keeps the mapping alive, neither handle is needed afterwards
+    HANDLE mapping = CreateFileMappingA( file, 0, PAGE_WRITECOPY, 0, 0, 0 );
+    CloseHandle( file );
+    if ( !mapping ) {
+        return 0;
+    }
+    void* view = MapViewOfFile( mapping, FILE_MAP_COPY, 0, 0, 0 );
+    CloseHandle( mapping );
+    if ( !view ) {
+        return 0;
+    }
 
+    *size = static_cast<size_t>( length.QuadPart );
+    return static_cast<char*>( view );
+#elif defined(TIXML_MMAP)
+    int fd = open( filepath, O_RDONLY );
+    if ( fd == -1 ) {
+        return 0;
+    }
 
-void XMLDocument::MarkInUse(XMLNode* node)
-{
-	TIXMLASSERT(node);
-	TIXMLASSERT(node->_parent == 0);
+    struct stat st;
+    const size_t pageSize = XMLUtil::PageSize();
+    if ( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) || st.st_size <= 0 ||
+         static_cast<unsigned long long>( st.st_size ) >= (size_t)-1 ||
+         pageSize == 0 || static_cast<size_t>( st.st_size ) % pageSize == 0 ) {
+        close( fd );
+        return 0;
+    }
 
-	for (int i = 0; i < _unlinked.Size(); ++i) {
-		if (node == _unlinked[i]) {
-			_unlinked.SwapRemove(i);
-			break;
-		}
-	}
+    void* view = mmap( 0, static_cast<size_t>( st.st_size ), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( view == MAP_FAILED ) {
+        return 0;
+    }
+
+    *size = static_cast<size_t>( st.st_size );
+    return static_cast<char*>( view );
+#else
+    (void)filepath;
+    (void)size;
+    return 0;
+#endif
 }
 
-void XMLDocument::Clear()
+static void UnmapFile( char* buffer, size_t size )
+{
+#if defined(_WIN32)
+    (void)size;
+    UnmapViewOfFile( buffer );
+#elif defined(TIXML_MMAP)
+    munmap( buffer, size );
+#else
+    (void)buffer;
+    (void)size;
+#endif
+}
+
+
+// A monotonic clock for the parse time in XMLStatistics
+static uint64_t TimerNanoseconds()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency( &frequency );
+    QueryPerformanceCounter( &counter );
+    const uint64_t ticks = static_cast<uint64_t>( counter.QuadPart );
+    const uint64_t perSecond = static_cast<uint64_t>( frequency.QuadPart );
+    return ticks / perSecond * 1000000000u + ticks % perSecond * 1000000000u / perSecond;
+#elif defined(TIXML_MMAP)
+    timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return static_cast<uint64_t>( now.tv_sec ) * 1000000000u + static_cast<uint64_t>( now.tv_nsec );
+#else
+    return static_cast<uint64_t>( clock() ) * 1000000000u / CLOCKS_PER_SEC;
+#endif
+}
+
+
+XMLPath::XMLPath( const char* path ) :
+    _buffer( 0 ),
+    _steps(),
+    _lengths()
+{
+    TIXMLASSERT( path );
+    const size_t length = strlen( path );
+    _buffer = new char[length + 1];
+    memcpy( _buffer, path, length + 1 );
+
+    // Empty steps, as in a leading or doubled '/', are ignored
+    const char* step = _buffer;
+    for( const char* p = _buffer; ; ++p ) {
+        if ( *p == '/' || !*p ) {
+            if ( p > step ) {
+                _steps.Push( step );
+                _lengths.Push( static_cast<size_t>( p - step ) );
+            }
+            if ( !*p ) {
+                break;
+            }
+            step = p + 1;
+        }
+    }
+}
+
+
+XMLPath::~XMLPath()
+{
+    delete [] _buffer;
+}
+
+
+bool XMLPath::Matches( int level, const char* name, size_t length ) const
+{
+    TIXMLASSERT( level >= 0 && level < Count() );
+    const char* step = _steps[level];
+    const size_t stepLength = _lengths[level];
+    if ( stepLength == 1 && *step == '*' ) {
+        return true;
+    }
+    return stepLength == length && memcmp( step, name, length ) == 0;
+}
+
+
+XMLNameTable::XMLNameTable() :
+    _slots( 0 ),
+    _capacity( 0 ),
+    _count( 0 ),
+    _blocks(),
+    _blockSizes(),
+    _free( 0 ),
+    _freeSize( 0 )
+{
+}
+
+
+XMLNameTable::~XMLNameTable()
+{
+    delete [] _slots;
+    for( int i = 0; i < _blocks.Size(); ++i ) {
+        delete [] _blocks[i];
+    }
+}
+
+
+const char* XMLNameTable::Intern( const char* name )
+{
+    TIXMLASSERT( name );
+    // Kept at most half full, so probing stays short
+    if ( ( _count + 1 ) * 2 > _capacity ) {
+        Grow();
+    }
+    const unsigned hash = Hash( name );
+    const int slot = Slot( name, hash );
+    if ( !_slots[slot] ) {
+        _slots[slot] = Store( name, strlen( name ) + 1 );
+        ++_count;
+    }
+    return _slots[slot];
+}
+
+
+const char* XMLNameTable::Find( const char* name ) const
+{
+    TIXMLASSERT( name );
+    if ( !_capacity ) {
+        return 0;
+    }
+    return _slots[Slot( name, Hash( name ) )];
+}
+
+
+bool XMLNameTable::Owns( const char* name ) const
+{
+    for( int i = 0; i < _blocks.Size(); ++i ) {
+        if ( name >= _blocks[i] && name < _blocks[i] + _blockSizes[i] ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// FNV-1a
+unsigned XMLNameTable::Hash( const char* name )
+{
+    unsigned hash = 2166136261u;
+    for( const unsigned char* p = reinterpret_cast<const unsigned char*>( name ); *p; ++p ) {
+        hash = ( hash ^ *p ) * 16777619u;
+    }
+    return hash;
+}
+
+
+// The slot holding 'name', or the empty slot where it belongs.
+int XMLNameTable::Slot( const char* name, unsigned hash ) const
+{
+    const int mask = _capacity - 1;
+    int slot = static_cast<int>( hash ) & mask;
+    while ( _slots[slot] && strcmp( _slots[slot], name ) != 0 ) {
+        slot = ( slot + 1 ) & mask;
+    }
+    return slot;
+}
+
+
+void XMLNameTable::Grow()
+{
+    const char** oldSlots = _slots;
+    const int oldCapacity = _capacity;
+    _capacity = _capacity ? _capacity * 2 : 64;
+    _slots = new const char*[_capacity];
+    memset( _slots, 0, _capacity * sizeof( *_slots ) );
+    for( int i = 0; i < oldCapacity; ++i ) {
+        if ( oldSlots[i] ) {
+            _slots[Slot( oldSlots[i], Hash( oldSlots[i] ) )] = oldSlots[i];
+        }
+    }
+    delete [] oldSlots;
+}
+
+
+char* XMLNameTable::Store( const char* name, size_t size )
+{
+    if ( size > _freeSize ) {
+        // Names longer than a block get one of their own
+        const size_t blockSize = size > static_cast<size_t>( BLOCK_SIZE ) ? size : static_cast<size_t>( BLOCK_SIZE );
+        _free = new char[blockSize];
+        _freeSize = blockSize;
+        _blocks.Push( _free );
+        _blockSizes.Push( blockSize );
+    }
+    char* copy = _free;
+    memcpy( copy, name, size );
+    _free += size;
+    _freeSize -= size;
+    return copy;
+}
+
+
+XMLDocument::XMLDocument( bool processEntities, Whitespace whitespaceMode ) :
+    XMLNode( 0 ),
+    _writeBOM( false ),
+    _processEntities( processEntities ),
+    _errorID(XML_SUCCESS),
+    _whitespaceMode( whitespaceMode ),
+    _errorStr(),
+    _errorLineNum( 0 ),
+    _charBuffer( 0 ),
+    _charBufferSize( 0 ),
+    _arenaMode( false ),
+    _mappedBuffer( 0 ),
+    _mappedSize( 0 ),
+    _parsePath( 0 ),
+    _nameTable( 0 ),
+    _parsedBytes( 0 ),
+    _parseNanoseconds( 0 ),
+    _parsePeakBytes( 0 ),
+    _parseCurLineNum( 0 ),
+	_parsingDepth(0),
+    _unlinked(),
+    _elementPool(),
+    _attributePool(),
+    _textPool(),
+    _commentPool()
+{
+    // avoid VC++ C4355 warning about 'this' in initializer list (C4355 is off by default in VS2012+)
+    _document = this;
+}
+
+
+XMLDocument::~XMLDocument()
+{
+    ReleaseMemory();
+}
+
+
+void XMLDocument::MarkInUse(XMLNode* node)
+{
+	TIXMLASSERT(node);
+	TIXMLASSERT(node->_parent == 0);
+
+	for (int i = 0; i < _unlinked.Size(); ++i) {
+		if (node == _unlinked[i]) {
+			_unlinked.SwapRemove(i);
+			break;
+		}
+	}
+}
+
+void XMLDocument::Clear()
 {
     DeleteChildren();
 	while( _unlinked.Size()) {
@@ -2056,9 +2803,21 @@ void XMLDocument::Clear()
 #endif
     ClearError();
 
-    delete [] _charBuffer;
-    _charBuffer = 0;
+    if ( _mappedBuffer ) {
+        UnmapFile( _mappedBuffer, _mappedSize );
+        _mappedBuffer = 0;
+        _mappedSize = 0;
+    }
+
+    if ( !_arenaMode ) {
+        delete [] _charBuffer;
+        _charBuffer = 0;
+        _charBufferSize = 0;
+    }
 	_parsingDepth = 0;
+    _parsedBytes = 0;
+    _parseNanoseconds = 0;
+    _parsePeakBytes = 0;
 
 #if 0
     _textPool.Trace( "text" );
@@ -2075,6 +2834,68 @@ void XMLDocument::Clear()
         TIXMLASSERT( _commentPool.CurrentAllocs()   == _commentPool.Untracked() );
     }
 #endif
+
+    if ( _arenaMode ) {
+        // Every node has been deleted, and anything a failed parse left
+        // behind is dead, so the pools can start over from the top.
+        _elementPool.Reset();
+        _attributePool.Reset();
+        _textPool.Reset();
+        _commentPool.Reset();
+    }
+}
+
+
+void XMLDocument::ReleaseMemory()
+{
+    const bool arena = _arenaMode;
+    _arenaMode = false;
+    Clear();
+    _arenaMode = arena;
+
+    _elementPool.Clear();
+    _attributePool.Clear();
+    _textPool.Clear();
+    _commentPool.Clear();
+}
+
+
+void XMLDocument::SetNameTable( XMLNameTable* table )
+{
+    Clear();
+    _nameTable = table;
+}
+
+
+XMLStatistics XMLDocument::Statistics() const
+{
+    XMLStatistics stats;
+    stats.bytesParsed = _parsedBytes;
+    stats.parseNanoseconds = _parseNanoseconds;
+    stats.elements = _elementPool.CurrentAllocs();
+    stats.nodes = _elementPool.CurrentAllocs() + _textPool.CurrentAllocs() + _commentPool.CurrentAllocs();
+    stats.attributes = _attributePool.CurrentAllocs();
+    stats.poolBlocks = _elementPool.Blocks() + _attributePool.Blocks() + _textPool.Blocks() + _commentPool.Blocks();
+    stats.poolItems = stats.nodes + stats.attributes;
+    stats.peakBytes = _parsePeakBytes;
+    return stats;
+}
+
+
+char* XMLDocument::CharBuffer( size_t size )
+{
+    // Grows geometrically so a run of slightly larger files doesn't
+    // reallocate every time
+    if ( size > _charBufferSize ) {
+        size_t capacity = size;
+        if ( _arenaMode && capacity < _charBufferSize * 2 ) {
+            capacity = _charBufferSize * 2;
+        }
+        delete [] _charBuffer;
+        _charBuffer = new char[capacity];
+        _charBufferSize = capacity;
+    }
+    return _charBuffer;
 }
 
 
@@ -2183,6 +3004,39 @@ XMLError XMLDocument::LoadFile( const char* filename )
     return _errorID;
 }
 
+
+XMLError XMLDocument::LoadFile( const char* filename, const XMLPath& path )
+{
+    _parsePath = &path;
+    LoadFile( filename );
+    _parsePath = 0;
+    return _errorID;
+}
+
+
+XMLError XMLDocument::LoadFileMapped( const char* filename )
+{
+    if ( !filename ) {
+        TIXMLASSERT( false );
+        SetError( XML_ERROR_FILE_COULD_NOT_BE_OPENED, 0, "filename=<null>" );
+        return _errorID;
+    }
+
+    Clear();
+    size_t size = 0;
+    char* buffer = MapFile( filename, &size );
+    if ( !buffer ) {
+        return LoadFile( filename );
+    }
+
+    TIXMLASSERT( buffer[size] == 0 );
+    _mappedBuffer = buffer;
+    _mappedSize = size;
+
+    Parse( size );
+    return _errorID;
+}
+
 // This is likely overengineered template art to have a check that unsigned long value incremented
 // by one still fits into size_t. If size_t type is larger than unsigned long type
 // (x86_64-w64-mingw32 target) then the check is redundant and gcc and clang emit
@@ -2237,8 +3091,7 @@ XMLError XMLDocument::LoadFile( FILE* fp )
     }
 
     const size_t size = filelength;
-    TIXMLASSERT( _charBuffer == 0 );
-    _charBuffer = new char[size+1];
+    CharBuffer( size+1 );
     size_t read = fread( _charBuffer, 1, size, fp );
     if ( read != size ) {
         SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
@@ -2247,7 +3100,7 @@ XMLError XMLDocument::LoadFile( FILE* fp )
 
     _charBuffer[size] = 0;
 
-    Parse();
+    Parse( size );
     return _errorID;
 }
 
@@ -2293,26 +3146,166 @@ XMLError XMLDocument::Parse( const char* p, size_t len )
     if ( len == (size_t)(-1) ) {
         len = strlen( p );
     }
-    TIXMLASSERT( _charBuffer == 0 );
-    _charBuffer = new char[ len+1 ];
+    CharBuffer( len+1 );
     memcpy( _charBuffer, p, len );
     _charBuffer[len] = 0;
 
-    Parse();
+    Parse( len );
     if ( Error() ) {
         // clean up now essentially dangling memory.
         // and the parse fail can put objects in the
         // pools that are dead and inaccessible.
         DeleteChildren();
-        _elementPool.Clear();
-        _attributePool.Clear();
-        _textPool.Clear();
-        _commentPool.Clear();
+        if ( _arenaMode ) {
+            _elementPool.Reset();
+            _attributePool.Reset();
+            _textPool.Reset();
+            _commentPool.Reset();
+        }
+        else {
+            _elementPool.Clear();
+            _attributePool.Clear();
+            _textPool.Clear();
+            _commentPool.Clear();
+        }
     }
     return _errorID;
 }
 
 
+XMLError XMLDocument::Parse( const char* p, size_t len, const XMLPath& path )
+{
+    _parsePath = &path;
+    Parse( p, len );
+    _parsePath = 0;
+    return _errorID;
+}
+
+
+// Skips past the next endTag. Returns 0 if the text ends first.
+static const char* SkipPast( const char* p, const char* endTag, int* curLineNumPtr )
+{
+    const size_t length = strlen( endTag );
+    for( ;; ) {
+        p = XMLUtil::FindChar( p, *endTag, curLineNumPtr );
+        if ( !*p ) {
+            return 0;
+        }
+        if ( XMLUtil::StringEqual( p, endTag, static_cast<int>( length ) ) ) {
+            return p + length;
+        }
+        ++p;
+    }
+}
+
+
+// Skips the rest of a start tag. Attribute values may hold '>' and '/'.
+static const char* SkipTag( const char* p, bool* selfClosing, int* curLineNumPtr )
+{
+    for( ;; ) {
+        if ( *p == '"' || *p == '\'' ) {
+            p = XMLUtil::FindChar( p + 1, *p, curLineNumPtr );
+            if ( !*p ) {
+                return 0;
+            }
+        }
+        else if ( *p == '>' ) {
+            *selfClosing = ( p[-1] == '/' );
+            return p + 1;
+        }
+        else if ( !*p ) {
+            return 0;
+        }
+        else if ( *p == '\n' ) {
+            ++(*curLineNumPtr);
+        }
+        ++p;
+    }
+}
+
+
+// Skips markup starting at the '<' at p, counting start and end tags from
+// 'depth' open elements until none are left; with 0 that is one node and
+// its subtree. Returns 0 if the text ends first.
+static const char* SkipMarkup( const char* p, int depth, int* curLineNumPtr )
+{
+    for( ;; ) {
+        TIXMLASSERT( *p == '<' );
+        if ( XMLUtil::StringEqual( p, "<!--", 4 ) ) {
+            p = SkipPast( p + 4, "-->", curLineNumPtr );
+        }
+        else if ( XMLUtil::StringEqual( p, "<![CDATA[", 9 ) ) {
+            p = SkipPast( p + 9, "]]>", curLineNumPtr );
+        }
+        else if ( p[1] == '?' ) {
+            p = SkipPast( p + 2, "?>", curLineNumPtr );
+        }
+        else if ( p[1] == '!' ) {
+            p = SkipPast( p + 2, ">", curLineNumPtr );
+        }
+        else if ( p[1] == '/' ) {
+            p = SkipPast( p + 2, ">", curLineNumPtr );
+            --depth;
+        }
+        else {
+            bool selfClosing = false;
+            p = SkipTag( p + 1, &selfClosing, curLineNumPtr );
+            if ( !selfClosing ) {
+                ++depth;
+            }
+        }
+
+        if ( !p ) {
+            return 0;
+        }
+        if ( depth <= 0 ) {
+            return p;
+        }
+        p = XMLUtil::FindChar( p, '<', curLineNumPtr );
+        if ( !*p ) {
+            return 0;
+        }
+    }
+}
+
+
+// Skips everything at the current level up to the next element on the
+// parse path, the closing tag of the parent, or the end of the text.
+char* XMLDocument::SkipUnmatched( char* p, int* curLineNumPtr )
+{
+    TIXMLASSERT( _parsePath );
+    // The document is depth 1, its children are the root step
+    const int level = _parsingDepth - 1;
+    if ( level >= _parsePath->Count() ) {
+        return p;	// Inside a match, everything is kept
+    }
+
+    for( ;; ) {
+        p = XMLUtil::SkipWhiteSpace( p, curLineNumPtr );
+        if ( !*p ) {
+            return p;
+        }
+        if ( *p != '<' ) {
+            p = const_cast<char*>( XMLUtil::FindChar( p, '<', curLineNumPtr ) );
+            continue;
+        }
+        if ( p[1] == '/' ) {
+            return p;
+        }
+        if ( XMLUtil::IsNameStartChar( p[1] ) ) {
+            const char* end = XMLUtil::SkipNameChars( p + 2 );
+            if ( _parsePath->Matches( level, p + 1, end - ( p + 1 ) ) ) {
+                return p;
+            }
+        }
+        p = const_cast<char*>( SkipMarkup( p, 0, curLineNumPtr ) );
+        if ( !p ) {
+            return 0;
+        }
+    }
+}
+
+
 void XMLDocument::Print( XMLPrinter* streamer ) const
 {
     if ( streamer ) {
@@ -2377,20 +3370,27 @@ const char* XMLDocument::ErrorName() const
     return ErrorIDToName(_errorID);
 }
 
-void XMLDocument::Parse()
+void XMLDocument::Parse( size_t size )
 {
     TIXMLASSERT( NoChildren() ); // Clear() must have been called previously
-    TIXMLASSERT( _charBuffer );
+    TIXMLASSERT( _charBuffer || _mappedBuffer );
+    const uint64_t start = TimerNanoseconds();
+    _parsedBytes = size;
     _parseCurLineNum = 1;
     _parseLineNum = 1;
-    char* p = _charBuffer;
+    char* p = _mappedBuffer ? _mappedBuffer : _charBuffer;
     p = XMLUtil::SkipWhiteSpace( p, &_parseCurLineNum );
     p = const_cast<char*>( XMLUtil::ReadBOM( p, &_writeBOM ) );
     if ( !*p ) {
         SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
-        return;
     }
-    ParseDeep(p, 0, &_parseCurLineNum );
+    else {
+        ParseDeep(p, 0, &_parseCurLineNum );
+    }
+    _parseNanoseconds = TimerNanoseconds() - start;
+    _parsePeakBytes = ( _mappedBuffer ? _mappedSize : _charBufferSize )
+                      + _elementPool.BlockMemory() + _attributePool.BlockMemory()
+                      + _textPool.BlockMemory() + _commentPool.BlockMemory();
 }
 
 void XMLDocument::PushDepth()
@@ -2407,6 +3407,280 @@ void XMLDocument::PopDepth()
 	--_parsingDepth;
 }
 
+XMLReader::XMLReader( const char* xml ) :
+    _start( xml ),
+    _p( xml ),
+    _event( START_ELEMENT ),
+    _errorID( XML_SUCCESS ),
+    _lineNum( 1 ),
+    _eventLineNum( 0 ),
+    _depth( 0 ),
+    _inTag( false ),
+    _name( "" ),
+    _nameLength( 0 ),
+    _value( "" ),
+    _valueLength( 0 ),
+    _valueFlags( 0 ),
+    _valueDecoded( false )
+{
+    TIXMLASSERT( xml );
+    bool bom = false;
+    _p = XMLUtil::SkipWhiteSpace( _p, &_lineNum );
+    _p = XMLUtil::ReadBOM( _p, &bom );
+    if ( !*_p ) {
+        Fail( XML_ERROR_EMPTY_DOCUMENT );
+    }
+}
+
+
+XMLReader::Event XMLReader::Next()
+{
+    if ( _event == END_DOCUMENT || _event == PARSE_ERROR ) {
+        return _event;
+    }
+    _valueDecoded = false;
+    if ( _inTag ) {
+        return ReadAttribute();
+    }
+    return ReadContent();
+}
+
+
+bool XMLReader::NextAttribute()
+{
+    if ( !_inTag || _event == PARSE_ERROR ) {
+        return false;
+    }
+    _p = XMLUtil::SkipWhiteSpace( _p, &_lineNum );
+    if ( *_p == '>' || ( *_p == '/' && _p[1] == '>' ) ) {
+        return false;
+    }
+    _valueDecoded = false;
+    return ReadAttribute() == ATTRIBUTE;
+}
+
+
+XMLReader::Event XMLReader::SkipElement()
+{
+    if ( _event == END_DOCUMENT || _event == PARSE_ERROR ) {
+        return _event;
+    }
+    if ( _openNames.Empty() ) {
+        return Fail( XML_ERROR_PARSING );
+    }
+    _valueDecoded = false;
+    if ( _inTag ) {
+        bool selfClosing = false;
+        _p = SkipTag( _p, &selfClosing, &_lineNum );
+        if ( !_p ) {
+            return Fail( XML_ERROR_PARSING_ELEMENT );
+        }
+        _inTag = false;
+        if ( selfClosing ) {
+            _eventLineNum = _lineNum;
+            return EndElement();
+        }
+    }
+    _p = XMLUtil::FindChar( _p, '<', &_lineNum );
+    _p = *_p ? SkipMarkup( _p, 1, &_lineNum ) : 0;
+    if ( !_p ) {
+        return Fail( XML_ERROR_PARSING );
+    }
+    _eventLineNum = _lineNum;
+    return EndElement();
+}
+
+
+bool XMLReader::NameIs( const char* name ) const
+{
+    TIXMLASSERT( name );
+    return strlen( name ) == _nameLength && strncmp( name, _name, _nameLength ) == 0;
+}
+
+
+const char* XMLReader::Value()
+{
+    if ( _event != ATTRIBUTE && _event != TEXT ) {
+        return "";
+    }
+    if ( !_valueDecoded ) {
+        // Decoding works in place, so it works on a copy
+        _buffer.Clear();
+        char* copy = _buffer.PushArr( static_cast<int>( _valueLength ) + 1 );
+        memcpy( copy, _value, _valueLength );
+        _decoded.Set( copy, copy + _valueLength, _valueFlags );
+        _valueDecoded = true;
+    }
+    return _decoded.GetStr();
+}
+
+
+XMLReader::Event XMLReader::ReadAttribute()
+{
+    TIXMLASSERT( _inTag );
+    _p = XMLUtil::SkipWhiteSpace( _p, &_lineNum );
+    _eventLineNum = _lineNum;
+    if ( *_p == '/' && _p[1] == '>' ) {
+        _p += 2;
+        _inTag = false;
+        return EndElement();
+    }
+    if ( *_p == '>' ) {
+        ++_p;
+        _inTag = false;
+        return ReadContent();
+    }
+    if ( !XMLUtil::IsNameStartChar( static_cast<unsigned char>( *_p ) ) ) {
+        return Fail( XML_ERROR_PARSING_ATTRIBUTE );
+    }
+
+    _name = _p;
+    _p = XMLUtil::SkipNameChars( _p + 1 );
+    _nameLength = _p - _name;
+    _p = XMLUtil::SkipWhiteSpace( _p, &_lineNum );
+    if ( *_p != '=' ) {
+        return Fail( XML_ERROR_PARSING_ATTRIBUTE );
+    }
+    _p = XMLUtil::SkipWhiteSpace( _p + 1, &_lineNum );
+    const char quote = *_p;
+    if ( quote != '"' && quote != '\'' ) {
+        return Fail( XML_ERROR_PARSING_ATTRIBUTE );
+    }
+    _value = _p + 1;
+    _p = XMLUtil::FindChar( _value, quote, &_lineNum );
+    if ( !*_p ) {
+        return Fail( XML_ERROR_PARSING_ATTRIBUTE );
+    }
+    _valueLength = _p - _value;
+    _valueFlags = StrPair::ATTRIBUTE_VALUE;
+    ++_p;
+    _event = ATTRIBUTE;
+    return _event;
+}
+
+
+XMLReader::Event XMLReader::ReadContent()
+{
+    for( ;; ) {
+        _depth = _openNames.Size();
+        if ( *_p != '<' ) {
+            if ( !*_p ) {
+                if ( !_openNames.Empty() ) {
+                    return Fail( XML_ERROR_PARSING );
+                }
+                _eventLineNum = _lineNum;
+                _event = END_DOCUMENT;
+                return _event;
+            }
+            const char* start = _p;
+            const char* text = XMLUtil::SkipWhiteSpace( start, &_lineNum );
+            const int textLineNum = _lineNum;
+            _p = XMLUtil::FindChar( text, '<', &_lineNum );
+            // Whitespace, and text outside the root, isn't reported
+            if ( text == _p || _openNames.Empty() ) {
+                continue;
+            }
+            _value = start;
+            _valueLength = _p - start;
+            _valueFlags = StrPair::TEXT_ELEMENT;
+            _eventLineNum = textLineNum;
+            _event = TEXT;
+            return _event;
+        }
+
+        _eventLineNum = _lineNum;
+        if ( XMLUtil::StringEqual( _p, "<![CDATA[", 9 ) ) {
+            _value = _p + 9;
+            _p = SkipPast( _value, "]]>", &_lineNum );
+            if ( !_p ) {
+                return Fail( XML_ERROR_PARSING_CDATA );
+            }
+            if ( _openNames.Empty() ) {
+                continue;
+            }
+            _valueLength = _p - 3 - _value;
+            _valueFlags = StrPair::NEEDS_NEWLINE_NORMALIZATION;
+            _event = TEXT;
+            return _event;
+        }
+        if ( XMLUtil::StringEqual( _p, "<!--", 4 ) ) {
+            _p = SkipPast( _p + 4, "-->", &_lineNum );
+            if ( !_p ) {
+                return Fail( XML_ERROR_PARSING_COMMENT );
+            }
+            continue;
+        }
+        if ( _p[1] == '?' ) {
+            _p = SkipPast( _p + 2, "?>", &_lineNum );
+            if ( !_p ) {
+                return Fail( XML_ERROR_PARSING_DECLARATION );
+            }
+            continue;
+        }
+        if ( _p[1] == '!' ) {
+            _p = SkipPast( _p + 2, ">", &_lineNum );
+            if ( !_p ) {
+                return Fail( XML_ERROR_PARSING_UNKNOWN );
+            }
+            continue;
+        }
+
+        if ( _p[1] == '/' ) {
+            const char* name = _p + 2;
+            const char* end = XMLUtil::SkipNameChars( name );
+            if ( _openNames.Empty()
+                 || static_cast<size_t>( end - name ) != _openLengths.PeekTop()
+                 || strncmp( name, _openNames.PeekTop(), end - name ) != 0 ) {
+                return Fail( XML_ERROR_MISMATCHED_ELEMENT );
+            }
+            _p = XMLUtil::SkipWhiteSpace( end, &_lineNum );
+            if ( *_p != '>' ) {
+                return Fail( XML_ERROR_PARSING_ELEMENT );
+            }
+            ++_p;
+            return EndElement();
+        }
+
+        if ( !XMLUtil::IsNameStartChar( static_cast<unsigned char>( _p[1] ) ) ) {
+            return Fail( XML_ERROR_PARSING_ELEMENT );
+        }
+        if ( _openNames.Size() + 1 >= TINYXML2_MAX_ELEMENT_DEPTH ) {
+            return Fail( XML_ELEMENT_DEPTH_EXCEEDED );
+        }
+        _name = _p + 1;
+        _p = XMLUtil::SkipNameChars( _name + 1 );
+        _nameLength = _p - _name;
+        _openNames.Push( _name );
+        _openLengths.Push( _nameLength );
+        _depth = _openNames.Size();
+        _inTag = true;
+        _event = START_ELEMENT;
+        return _event;
+    }
+}
+
+
+XMLReader::Event XMLReader::EndElement()
+{
+    TIXMLASSERT( !_openNames.Empty() );
+    _depth = _openNames.Size();
+    _name = _openNames.Pop();
+    _nameLength = _openLengths.Pop();
+    _event = END_ELEMENT;
+    return _event;
+}
+
+
+XMLReader::Event XMLReader::Fail( XMLError error )
+{
+    _errorID = error;
+    _eventLineNum = _lineNum;
+    _inTag = false;
+    _event = PARSE_ERROR;
+    return _event;
+}
+
+
 XMLPrinter::XMLPrinter( FILE* file, bool compact, int depth ) :
     _elementJustOpened( false ),
     _stack(),
@@ -364,12 +364,35 @@ public:
         _nUntracked = 0;
     }
 
+    // Rewinds the pool but keeps the blocks, so the next document is carved
+    // out of the same memory in address order. Only valid once every item
+    // has been freed or is known to be dead.
+    void Reset() {
+        _root = 0;
+        for( int b = _blockPtrs.Size() - 1; b >= 0; --b ) {
+            Item* blockItems = _blockPtrs[b]->items;
+            for( int i = 0; i < ITEMS_PER_BLOCK - 1; ++i ) {
+                blockItems[i].next = &(blockItems[i + 1]);
+            }
+            blockItems[ITEMS_PER_BLOCK - 1].next = _root;
+            _root = blockItems;
+        }
+        _currentAllocs = 0;
+        _nUntracked = 0;
+    }
+
     virtual int ItemSize() const	{
         return ITEM_SIZE;
     }
     int CurrentAllocs() const		{
         return _currentAllocs;
     }
+    int Blocks() const				{
+        return _blockPtrs.Size();
+    }
+    size_t BlockMemory() const		{
+        return _blockPtrs.Size() * sizeof( Block );
+    }
 
     virtual void* Alloc() {
         if ( !_root ) {
@@ -553,11 +576,9 @@ public:
     static const char* SkipWhiteSpace( const char* p, int* curLineNumPtr )	{
         TIXMLASSERT( p );
 
-        while( IsWhiteSpace(*p) ) {
-            if (curLineNumPtr && *p == '\n') {
-                ++(*curLineNumPtr);
-            }
-            ++p;
+        // Usually there is nothing to skip, only actual runs go to the vector scanner
+        if ( IsWhiteSpace(*p) ) {
+            p = SkipWhiteSpaceRun( p, curLineNumPtr );
         }
         TIXMLASSERT( p );
         return p;
@@ -566,6 +587,22 @@ public:
         return const_cast<char*>( SkipWhiteSpace( const_cast<const char*>(p), curLineNumPtr ) );
     }
 
+    // The scanners below test 16 or 32 bytes at a time where the CPU
+    // supports it. All stop at the terminating null.
+    // Skips whitespace, counting newlines if curLineNumPtr is set.
+    static const char* SkipWhiteSpaceRun( const char* p, int* curLineNumPtr );
+    // The first c or null, counting the newlines before it if curLineNumPtr is set.
+    static const char* FindChar( const char* p, char c, int* curLineNumPtr );
+    // The first byte that can't be part of a name.
+    static const char* SkipNameChars( const char* p );
+    // Forces the scalar scanners, or goes back to the best the CPU has. For
+    // checking one against the other; not thread safe, set it before parsing.
+    static void SetVectorScanning( bool enable );
+    static bool VectorScanning();
+    // Page size of memory mapped files, 0 where they aren't mapped. A file
+    // that isn't a multiple of it is null terminated once mapped.
+    static size_t PageSize();
+
     // Anything in the high order range of UTF-8 is assumed to not be whitespace. This isn't
     // correct, but simple, and usually works.
     static bool IsWhiteSpace( char p )					{
@@ -963,6 +1000,7 @@ private:
     static void DeleteNode( XMLNode* node );
     void InsertChildPreamble( XMLNode* insertThis ) const;
     const XMLElement* ToElementWithName( const char* name ) const;
+    bool LookupName( const char** name ) const;
 
     XMLNode( const XMLNode& );	// not supported
     XMLNode& operator=( const XMLNode& );	// not supported
@@ -1645,6 +1683,107 @@ enum Whitespace {
 };
 
 
+/**
+	A compiled element path for partial parsing, see XMLDocument::Parse().
+	Element names separated by '/', starting at the root element:
+	@verbatim
+		XMLPath path( "package/content/resources" );
+	@endverbatim
+	A "*" step matches any element.
+*/
+class TINYXML2_LIB XMLPath
+{
+public:
+    explicit XMLPath( const char* path );
+    ~XMLPath();
+
+    /// The number of steps in the path.
+    int Count() const {
+        return _steps.Size();
+    }
+    /// True if the element name matches step 'level' (0 is the root element).
+    bool Matches( int level, const char* name, size_t length ) const;
+
+private:
+    XMLPath( const XMLPath& );	// not supported
+    void operator=( const XMLPath& );	// not supported
+
+    char* _buffer;
+    DynArray< const char*, 8 > _steps;
+    DynArray< size_t, 8 > _lengths;
+};
+
+
+/**
+	A pool of distinct element and attribute names that documents can
+	share, see XMLDocument::SetNameTable(). Each name is stored once and
+	every node with that name points at the same copy.
+
+	Interning changes the table, so documents sharing one have to be
+	parsed and edited one at a time; reading them is fine from any thread.
+*/
+class TINYXML2_LIB XMLNameTable
+{
+public:
+    XMLNameTable();
+    ~XMLNameTable();
+
+    /// Returns the table's copy of 'name', adding it if it is new.
+    const char* Intern( const char* name );
+    /// Returns the table's copy of 'name', or null if it was never added.
+    const char* Find( const char* name ) const;
+    /// True if 'name' is one of the table's copies.
+    bool Owns( const char* name ) const;
+
+    /// The number of distinct names.
+    int Count() const {
+        return _count;
+    }
+
+private:
+    XMLNameTable( const XMLNameTable& );	// not supported
+    void operator=( const XMLNameTable& );	// not supported
+
+    static unsigned Hash( const char* name );
+    int Slot( const char* name, unsigned hash ) const;
+    void Grow();
+    char* Store( const char* name, size_t size );
+
+    enum { BLOCK_SIZE = 4096 };
+    const char**	_slots;		// Open addressing, the size is a power of 2
+    int				_capacity;
+    int				_count;
+    DynArray< char*, 8 > _blocks;
+    DynArray< size_t, 8 > _blockSizes;
+    char*			_free;
+    size_t			_freeSize;
+};
+
+
+
+/**
+	Counters describing a document and the parse that built it, see
+	XMLDocument::Statistics(). Node and attribute counts include those
+	created but not (yet) linked into the document.
+*/
+struct XMLStatistics
+{
+    size_t		bytesParsed;		///< Size of the text handed to the last Parse() or LoadFile()
+    uint64_t	parseNanoseconds;	///< Wall time of that parse
+    int			elements;
+    int			nodes;				///< Elements, text, comments, declarations and unknowns
+    int			attributes;
+    int			poolBlocks;			///< Blocks held by the node and attribute pools
+    int			poolItems;			///< Nodes and attributes allocated from them
+    /**
+    	The character buffer, or mapped file, plus the pool blocks at the
+    	end of the last parse. Nothing is freed while parsing, so this is
+    	the parse's peak.
+    */
+    size_t		peakBytes;
+};
+
+
 /** A Document binds together all the functionality.
 	It can be saved, loaded, and printed to the screen.
 	All Nodes are connected and allocated to a Document.
@@ -1686,6 +1825,19 @@ public:
     */
     XMLError Parse( const char* xml, size_t nBytes=(size_t)(-1) );
 
+    /**
+    	Parse only the elements along 'path'. Elements at each level that
+    	don't match the next step, and all text, comments and other
+    	nodes beside the path, are skipped over in the raw text without
+    	creating nodes. Elements that match the whole path are parsed
+    	with their full subtree. The DOM ends up holding just the
+    	matching elements and their ancestors.
+
+    	Skipped content is only checked for balanced tags, the names of
+    	skipped start and end tags aren't compared.
+    */
+    XMLError Parse( const char* xml, size_t nBytes, const XMLPath& path );
+
     /**
     	Load an XML file from disk.
     	Returns XML_SUCCESS (0) on success, or
@@ -1693,6 +1845,9 @@ public:
     */
     XMLError LoadFile( const char* filename );
 
+    /// LoadFile() parsing only the elements along 'path', see Parse().
+    XMLError LoadFile( const char* filename, const XMLPath& path );
+
     /**
     	Load an XML file from disk. You are responsible
     	for providing and closing the FILE*.
@@ -1706,6 +1861,19 @@ public:
     */
     XMLError LoadFile( FILE* );
 
+    /**
+    	Load an XML file from disk by mapping it copy-on-write instead of
+    	reading it into a buffer. Pages are only read as the parser gets
+    	to them and the file is never copied as a whole. Falls back to
+    	LoadFile() when the file can't be mapped, or when its size is a
+    	multiple of the page size and there is no room for the null
+    	terminator.
+
+    	Returns XML_SUCCESS (0) on success, or
+    	an errorID.
+    */
+    XMLError LoadFileMapped( const char* filename );
+
     /**
     	Save the XML file to disk.
     	Returns XML_SUCCESS (0) on success, or
@@ -1812,7 +1980,11 @@ public:
     void DeleteNode( XMLNode* node );
 
     void ClearError() {
-        SetError(XML_SUCCESS, 0, 0);
+        // Not through SetError(), formatting a success message on every
+        // Clear() would cost two allocations per document
+        _errorID = XML_SUCCESS;
+        _errorLineNum = 0;
+        _errorStr.Reset();
     }
 
     /// Return true if there was an error parsing the document.
@@ -1843,6 +2015,41 @@ public:
     /// Clear the document, resetting it to the initial state.
     void Clear();
 
+    /**
+    	In arena mode Clear(), and with it every Parse() and LoadFile(),
+    	keeps the memory of the previous document: the node pools are
+    	rewound instead of freed and the character buffer is reused when
+    	it is large enough. Meant for loading many documents in a row
+    	with one XMLDocument. Off by default.
+    */
+    void SetArenaMode( bool arena ) {
+        _arenaMode = arena;
+    }
+    bool ArenaMode() const {
+        return _arenaMode;
+    }
+
+    /// Clear the document and free the memory kept in arena mode.
+    void ReleaseMemory();
+
+    /**
+    	Makes element and attribute names, parsed or set, pointers into
+    	'table' instead of copies per node, and looking up elements by
+    	name a pointer comparison. Names passed to the lookups are found
+    	in the table first, unless they come from it already: from
+    	XMLNameTable::Intern() or the Name() of another node. Useful when
+    	many documents with the same vocabulary stay loaded. The table is
+    	not owned and has to outlive the document. Clears the document,
+    	as the names already in it aren't in the table.
+    */
+    void SetNameTable( XMLNameTable* table );
+    XMLNameTable* NameTable() const {
+        return _nameTable;
+    }
+
+    /// Counters for the current document, cheap enough to call after every parse.
+    XMLStatistics Statistics() const;
+
 	/**
 		Copies this document to a target document.
 		The target will be completely cleared before the copy.
@@ -1876,6 +2083,15 @@ private:
     mutable StrPair	_errorStr;
     int             _errorLineNum;
     char*			_charBuffer;
+    size_t			_charBufferSize;
+    bool			_arenaMode;
+    char*			_mappedBuffer;
+    size_t			_mappedSize;
+    const XMLPath*	_parsePath;
+    XMLNameTable*	_nameTable;
+    size_t			_parsedBytes;
+    uint64_t		_parseNanoseconds;
+    size_t			_parsePeakBytes;
     int				_parseCurLineNum;
 	int				_parsingDepth;
 	// Memory tracking does add some overhead.
@@ -1893,7 +2109,9 @@ private:
 
 	static const char* _errorNames[XML_ERROR_COUNT];
 
-    void Parse();
+    void Parse( size_t size );
+    char* CharBuffer( size_t size );
+    char* SkipUnmatched( char* p, int* curLineNumPtr );
 
     void SetError( XMLError error, int lineNum, const char* format, ... );
 
@@ -1932,6 +2150,131 @@ inline NodeType* XMLDocument::CreateUnlinkedNode( MemPoolT<PoolElementSize>& poo
     return returnNode;
 }
 
+/**
+	A pull parser: reads a document as a stream of events instead of
+	building a DOM. Memory use depends on the nesting depth and the
+	longest value read, not on the size of the document, and reading
+	can stop at any point.
+
+	@verbatim
+	XMLReader reader( xml );
+	while ( reader.Next() != XMLReader::END_DOCUMENT ) {
+		if ( reader.Current() == XMLReader::PARSE_ERROR ) {
+			break;
+		}
+		if ( reader.Current() == XMLReader::START_ELEMENT && reader.NameIs( "skipme" ) ) {
+			reader.SkipElement();
+		}
+	}
+	@endverbatim
+
+	An element produces START_ELEMENT, one ATTRIBUTE per attribute, its
+	content, then END_ELEMENT; <empty/> elements included. Text that is
+	only whitespace isn't reported, CDATA sections are reported as TEXT.
+	Comments, processing instructions and DOCTYPEs are skipped.
+*/
+class TINYXML2_LIB XMLReader
+{
+public:
+    enum Event {
+        START_ELEMENT,
+        ATTRIBUTE,
+        TEXT,
+        END_ELEMENT,
+        END_DOCUMENT,
+        PARSE_ERROR
+    };
+
+    /// Reads the null terminated 'xml', which has to stay valid and unchanged while reading.
+    explicit XMLReader( const char* xml );
+
+    /// Moves to the next event. END_DOCUMENT and PARSE_ERROR are final.
+    Event Next();
+    Event Current() const {
+        return _event;
+    }
+
+    /**
+    	Moves to the next attribute of the element that just started.
+    	Returns false, without reading on, once the start tag is done.
+    	Unlike Next() this never moves into the element's content.
+    */
+    bool NextAttribute();
+
+    /**
+    	Skips the rest of the innermost open element, without reporting
+    	anything inside it, and moves to its END_ELEMENT. Skipped content
+    	is only checked for balanced tags.
+    */
+    Event SkipElement();
+
+    /**
+    	The element name for START_ELEMENT and END_ELEMENT, the attribute
+    	name for ATTRIBUTE. Points into the document and is not null
+    	terminated, see NameLength() and NameIs().
+    */
+    const char* Name() const {
+        return _name;
+    }
+    size_t NameLength() const {
+        return _nameLength;
+    }
+    bool NameIs( const char* name ) const;
+
+    /**
+    	The attribute value or text, with entities and newlines
+    	translated. Valid until the next call that moves the reader.
+    */
+    const char* Value();
+
+    /// Number of open elements, counting the current one for START_ELEMENT and END_ELEMENT.
+    int Depth() const {
+        return _depth;
+    }
+    /// Line of the current event.
+    int LineNum() const {
+        return _eventLineNum;
+    }
+    XMLError ErrorID() const {
+        return _errorID;
+    }
+    /// How far into the document reading has got, in bytes.
+    size_t BytesRead() const {
+        return static_cast<size_t>( _p - _start );
+    }
+
+private:
+    XMLReader( const XMLReader& );	// not supported
+    void operator=( const XMLReader& );	// not supported
+
+    Event ReadAttribute();
+    Event ReadContent();
+    Event EndElement();
+    Event Fail( XMLError error );
+
+    const char*	_start;
+    const char*	_p;
+    Event		_event;
+    XMLError	_errorID;
+    int			_lineNum;
+    int			_eventLineNum;
+    int			_depth;
+    bool		_inTag;	// Between an element's name and the end of its start tag
+
+    const char*	_name;
+    size_t		_nameLength;
+    const char*	_value;
+    size_t		_valueLength;
+    int			_valueFlags;
+    bool		_valueDecoded;
+    StrPair		_decoded;
+    DynArray< char, 256 > _buffer;
+
+    DynArray< const char*, 16 > _openNames;
+    DynArray< size_t, 16 > _openLengths;
+};
+
+
 /**
 	A XMLHandle is a class that wraps a node pointer with null checks; this is
 	an incredibly useful thing. Note that XMLHandle is not part of the TinyXML-2